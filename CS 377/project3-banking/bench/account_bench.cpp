@@ -0,0 +1,84 @@
+#include <bank.h>
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// Cost of false sharing between adjacent accounts.
+//
+// hot:  `threads` workers each deposit `ops` times into their *own*
+//       account, accounts 0..threads-1. There is no logical contention, so
+//       any slowdown of the packed layout against the padded one is the
+//       cache lines ping-ponging between cores.
+// scan: totalBalance() over `scan_accounts` accounts, `scans` times, which
+//       is where the structure-of-arrays layout pays off.
+// Output is CSV on stdout.
+
+using namespace std;
+
+static const char *name(int layout) {
+  if (layout == BANK_PADDED) return "padded";
+  if (layout == BANK_SOA) return "soa";
+  return "packed";
+}
+
+static Bank *quiet_bank(int n, int flags) {
+  stringstream sink;
+  streambuf *old = cout.rdbuf(sink.rdbuf());  // hide the account dump
+  Bank *bank = new Bank(n, flags);
+  cout.rdbuf(old);
+  return bank;
+}
+
+static void quiet_delete(Bank *bank) {
+  stringstream sink;
+  streambuf *old = cout.rdbuf(sink.rdbuf());
+  delete bank;
+  cout.rdbuf(old);
+}
+
+int main(int argc, char *argv[]) {
+  int threads = argc > 1 ? atoi(argv[1]) : 8;
+  int ops = argc > 2 ? atoi(argv[2]) : 1000000;
+  int scan_accounts = argc > 3 ? atoi(argv[3]) : 100000;
+  int scans = argc > 4 ? atoi(argv[4]) : 200;
+  if (threads <= 0 || ops <= 0 || scan_accounts <= 0 || scans <= 0) {
+    fprintf(stderr, "Usage: %s [threads] [ops] [scan_accounts] [scans]\n",
+            argv[0]);
+    return -1;
+  }
+
+  printf("test,layout,threads,accounts,ops,seconds,ops_per_sec\n");
+  for (int layout : {0, BANK_PADDED, BANK_SOA}) {
+    Bank *bank = quiet_bank(threads, BANK_QUIET | layout);
+    vector<thread> workers;
+    auto start = chrono::steady_clock::now();
+    for (int w = 0; w < threads; w++) {
+      workers.emplace_back([bank, w, ops] {
+        for (int k = 0; k < ops; k++) bank->deposit(w, k, w, 1);
+      });
+    }
+    for (auto &t : workers) t.join();
+    double secs =
+        chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    long total = (long)threads * ops;
+    printf("hot,%s,%d,%d,%ld,%.4f,%.0f\n", name(layout), threads, threads,
+           total, secs, total / secs);
+    quiet_delete(bank);
+  }
+
+  for (int layout : {0, BANK_PADDED, BANK_SOA}) {
+    Bank *bank = quiet_bank(scan_accounts, BANK_QUIET | layout);
+    long sum = 0;
+    auto start = chrono::steady_clock::now();
+    for (int k = 0; k < scans; k++) sum += bank->totalBalance();
+    double secs =
+        chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    long total = (long)scans * scan_accounts;
+    printf("scan,%s,1,%d,%ld,%.4f,%.0f\n", name(layout), scan_accounts, total,
+           secs, total / secs);
+    if (sum != 0) return 1;  // keeps the scans from being optimized away
+    quiet_delete(bank);
+  }
+  return 0;
+}
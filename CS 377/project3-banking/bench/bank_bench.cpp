@@ -0,0 +1,246 @@
+#include <ledger.h>
+#include <ledgerFile.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <vector>
+
+// End-to-end throughput of run_shared() on synthetic ledgers.
+//
+// A ledger of `entries` entries is generated over `accounts` accounts.
+// Accounts are drawn from a Zipf distribution with exponent `skew` (0 =
+// uniform; account 0 is the hottest), and modes from the D/W/T mix. Then
+// every combination of producer count, consumer count and bb_size is run
+// once. Per combination the CSV row holds:
+//   ops_per_sec   ledger entries applied per second of wall time
+//   p50_us/p99_us time from an entry entering the buffer to being applied
+//   lock_wait_ms  total time consumers spent blocked on account locks
+// With -W, each combination is also run once per durability level in -D,
+// logging to that write-ahead log file (recreated for every run); the time
+// includes the final flush, and wal_groups counts the group commits.
+// Output is CSV on stdout.
+
+using namespace std;
+
+static int entries = 200000, accounts = 10;
+static double skew = 0.99;
+static int mix[3] = {40, 30, 30};  // D, W, T percent
+static vector<int> producers = {1, 2, 4};
+static vector<int> consumers = {1, 2, 4, 8};
+static vector<int> sizes = {1, 16, 256};
+static const char *wal_file = NULL;
+static vector<int> levels = {-1};  // WAL_* levels, -1 = no log
+static const char *level_names[] = {"async", "group", "sync"};
+
+// Samples ranks 0..n-1 with P(k) proportional to 1 / (k + 1)^s.
+class Zipf {
+ public:
+  Zipf(int n, double s) : cdf(n) {
+    double sum = 0;
+    for (int k = 0; k < n; k++) cdf[k] = sum += 1.0 / pow(k + 1, s);
+    for (double &c : cdf) c /= sum;
+  }
+  template <typename Rng>
+  int operator()(Rng &rng) {
+    double u = uniform_real_distribution<double>(0, 1)(rng);
+    int k = lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+    return min(k, (int)cdf.size() - 1);
+  }
+
+ private:
+  vector<double> cdf;
+};
+
+static void generate(unsigned seed) {
+  mt19937 rng(seed);
+  Zipf account(accounts, skew);
+  uniform_int_distribution<int> percent(0, 99), amount(1, 100);
+  ledger_arena.clear();
+  ledger_arena.reserve(entries);
+  for (int i = 0; i < entries; i++) {
+    int p = percent(rng);
+    int mode = p < mix[0] ? D : p < mix[0] + mix[1] ? W : T;
+    int acc = account(rng);
+    int other = mode == T ? account(rng) : 0;
+    ledger_arena.push_back(Ledger{acc, other, amount(rng), mode, i});
+  }
+}
+
+static vector<int> parse_list(const char *arg) {
+  vector<int> out;
+  stringstream in(arg);
+  string item;
+  while (getline(in, item, ',')) {
+    if (atoi(item.c_str()) > 0) out.push_back(atoi(item.c_str()));
+  }
+  return out;
+}
+
+static vector<int> parse_levels(const char *arg) {
+  vector<int> out;
+  stringstream in(arg);
+  string item;
+  while (getline(in, item, ',')) {
+    if (item == "none") out.push_back(-1);
+    for (int l = 0; l < 3; l++) {
+      if (item == level_names[l]) out.push_back(l);
+    }
+  }
+  return out;
+}
+
+static void run(int p, int c, int size, int level) {
+  vector<uint64_t> enq(entries), done(entries);
+  trace_enqueue = enq.data();
+  trace_done = done.data();
+  max_items = entries;
+  con_items = 0;
+
+  stringstream sink;
+  streambuf *old = cout.rdbuf(sink.rdbuf());  // hide the account dump
+  bank = new Bank(accounts, opts.bank_flags | BANK_QUIET | BANK_TIMED);
+  WriteAheadLog *wal = NULL;
+  if (level >= 0) {
+    unlink(wal_file);
+    wal = new WriteAheadLog(wal_file, level, opts.wal_interval_us);
+    if (!wal->ok()) {
+      perror(wal_file);
+      exit(-1);
+    }
+    bank->setWal(wal);
+  }
+
+  auto start = chrono::steady_clock::now();
+  run_shared(p, c, size);
+  long groups = 0;
+  if (wal != NULL) {
+    bank->checkWal(wal->flush());
+    groups = wal->getGroups();
+    delete wal;
+  }
+  double secs =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  long wait_ns = bank->getLockWaitNs();
+  int applied = bank->getNumSucc() + bank->getNumFail();
+
+  delete bank;
+  cout.rdbuf(old);
+  trace_enqueue = trace_done = NULL;
+
+  vector<uint64_t> lat(entries);
+  for (int i = 0; i < entries; i++) lat[i] = done[i] - enq[i];
+  sort(lat.begin(), lat.end());
+  double p50 = lat[entries / 2] / 1e3;
+  double p99 = lat[min(entries - 1, (int)(entries * 0.99))] / 1e3;
+
+  printf("%d,%d,%d,%d,%d,%.2f,%d,%.4f,%.0f,%.1f,%.1f,%.3f,%s,%ld\n", p, c,
+         size, entries, accounts, skew, applied, secs, applied / secs, p50, p99,
+         wait_ns / 1e6, level >= 0 ? level_names[level] : "none", groups);
+  fflush(stdout);
+}
+
+static void usage(char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-n entries] [-a accounts] [-s skew] [-m D,W,T]\n"
+          "          [-P producers] [-C consumers] [-B sizes] [-l] [-g] [-x]\n"
+          "          [-b batch] [-r seed] [-o ledger_file]\n"
+          "          [-W wal_file [-D levels] [-F usec]]\n"
+          "  -P/-C/-B take comma separated lists to sweep over\n"
+          "  -D       comma separated durability levels: none, async, group,\n"
+          "           sync (default: all of them)\n"
+          "  -o       only write the generated ledger (text) and exit\n",
+          prog);
+  exit(-1);
+}
+
+int main(int argc, char *argv[]) {
+  const char *out = NULL;
+  const char *level_arg = NULL;
+  unsigned seed = SEED_RANDOM;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:a:s:m:P:C:B:lgxb:o:r:W:D:F:")) != -1) {
+    switch (opt) {
+      case 'n':
+        entries = atoi(optarg);
+        break;
+      case 'a':
+        accounts = atoi(optarg);
+        break;
+      case 's':
+        skew = atof(optarg);
+        break;
+      case 'm':
+        if (sscanf(optarg, "%d,%d,%d", &mix[0], &mix[1], &mix[2]) != 3 ||
+            mix[0] + mix[1] + mix[2] != 100) {
+          usage(argv[0]);
+        }
+        break;
+      case 'P':
+        producers = parse_list(optarg);
+        break;
+      case 'C':
+        consumers = parse_list(optarg);
+        break;
+      case 'B':
+        sizes = parse_list(optarg);
+        break;
+      case 'l':
+        opts.bb_mode = BB_LOCKFREE;
+        break;
+      case 'g':
+        opts.group_commit = 1;
+        break;
+      case 'x':
+        opts.bank_flags |= BANK_ATOMIC;
+        break;
+      case 'b':
+        opts.batch = atoi(optarg);
+        break;
+      case 'o':
+        out = optarg;
+        break;
+      case 'W':
+        wal_file = optarg;
+        break;
+      case 'D':
+        level_arg = optarg;
+        break;
+      case 'F':
+        opts.wal_interval_us = atoi(optarg);
+        break;
+      case 'r':
+        seed = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (wal_file != NULL) {
+    levels = level_arg != NULL ? parse_levels(level_arg)
+                               : vector<int>{-1, WAL_ASYNC, WAL_GROUP, WAL_SYNC};
+  }
+  if (entries <= 0 || accounts <= 0 || skew < 0 || opts.batch < 1 ||
+      producers.empty() || consumers.empty() || sizes.empty() ||
+      levels.empty() || opts.wal_interval_us < 1) {
+    usage(argv[0]);
+  }
+
+  generate(seed);
+  if (out != NULL) {
+    return write_ledger_text(out, ledger_arena) < 0 ? -1 : 0;
+  }
+
+  printf("producers,consumers,bb_size,entries,accounts,skew,applied,seconds,"
+         "ops_per_sec,p50_us,p99_us,lock_wait_ms,durability,wal_groups\n");
+  for (int p : producers) {
+    for (int c : consumers) {
+      for (int size : sizes) {
+        for (int level : levels) run(p, c, size, level);
+      }
+    }
+  }
+  return 0;
+}
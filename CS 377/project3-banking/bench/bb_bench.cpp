@@ -0,0 +1,75 @@
+#include <boundedBuffer.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// Producer/consumer throughput of the two BoundedBuffer backends.
+//
+// For every thread count t in 1, 2, 4, ..., max_threads, t producers and t
+// consumers move `items` ints through a buffer of `bb_size` slots, one at a
+// time and then `batch` at a time with append_n()/remove_up_to(). One item
+// moved from a producer to a consumer counts as one op. Output is CSV on
+// stdout.
+
+using namespace std;
+
+static void run(int mode, int threads, int bb_size, int items, int batch) {
+  BoundedBuffer<int> bb(bb_size, mode);
+  int per_thread = items / threads;
+  vector<thread> workers;
+
+  auto start = chrono::steady_clock::now();
+  for (int i = 0; i < threads; i++) {
+    workers.emplace_back([&bb, per_thread, batch, i] {
+      if (batch == 1) {
+        for (int k = 0; k < per_thread; k++) bb.append(i);
+        return;
+      }
+      vector<int> span(batch, i);
+      for (int k = 0; k < per_thread; k += batch) {
+        bb.append_n(span.data(), min(batch, per_thread - k));
+      }
+    });
+    workers.emplace_back([&bb, per_thread, batch] {
+      if (batch == 1) {
+        for (int k = 0; k < per_thread; k++) bb.remove();
+        return;
+      }
+      vector<int> span(batch);
+      for (int k = 0; k < per_thread;) {
+        k += bb.remove_up_to(span.data(), min(batch, per_thread - k));
+      }
+    });
+  }
+  for (auto &w : workers) w.join();
+  double secs =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  long ops = (long)per_thread * threads;
+  printf("%s,%d,%d,%d,%ld,%.4f,%.0f\n",
+         mode == BB_LOCKFREE ? "lockfree" : "mutex", threads, bb_size, batch,
+         ops, secs, ops / secs);
+}
+
+int main(int argc, char *argv[]) {
+  int max_threads = argc > 1 ? atoi(argv[1]) : 64;
+  int bb_size = argc > 2 ? atoi(argv[2]) : 1024;
+  int items = argc > 3 ? atoi(argv[3]) : 1000000;
+  int batch = argc > 4 ? atoi(argv[4]) : 32;
+
+  if (max_threads <= 0 || bb_size <= 0 || items <= 0 || batch <= 0) {
+    fprintf(stderr, "Usage: %s [max_threads] [bb_size] [items] [batch]\n",
+            argv[0]);
+    return -1;
+  }
+
+  printf("mode,threads,bb_size,batch,ops,seconds,ops_per_sec\n");
+  for (int t = 1; t <= max_threads; t *= 2) {
+    for (int b : {1, batch}) {
+      run(BB_MUTEX, t, bb_size, items, b);
+      run(BB_LOCKFREE, t, bb_size, items, b);
+      if (batch == 1) break;
+    }
+  }
+  return 0;
+}
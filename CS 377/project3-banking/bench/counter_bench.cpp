@@ -0,0 +1,114 @@
+#include <bank.h>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// Contention on the success/fail counters.
+//
+// `threads` consumers each apply `ops` deposits to random accounts out of
+// `accounts`, taking the account lock as Bank::deposit does, and count the
+// outcome with one of:
+//   global_lock    a mutex-protected int, as the bank did originally
+//   global_atomic  one shared std::atomic counter
+//   sharded        one cache-line padded counter per consumer
+//   bank           the real Bank::deposit (BANK_QUIET, sharded counters)
+// Output is CSV on stdout.
+
+using namespace std;
+
+struct PlainAccount {
+  long balance;
+  pthread_mutex_t lock;
+};
+
+static int threads = 32, accounts = 10, ops = 200000;
+
+template <typename Count>
+static double run(Count count) {
+  vector<PlainAccount> acct(accounts);
+  for (auto &a : acct) {
+    a.balance = 0;
+    pthread_mutex_init(&a.lock, NULL);
+  }
+
+  vector<thread> workers;
+  auto start = chrono::steady_clock::now();
+  for (int w = 0; w < threads; w++) {
+    workers.emplace_back([&acct, &count, w] {
+      minstd_rand rng(w);
+      for (int k = 0; k < ops; k++) {
+        PlainAccount &a = acct[rng() % accounts];
+        pthread_mutex_lock(&a.lock);
+        a.balance += 1;
+        pthread_mutex_unlock(&a.lock);
+        count(w);
+      }
+    });
+  }
+  for (auto &t : workers) t.join();
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static double run_bank() {
+  stringstream sink;
+  streambuf *old = cout.rdbuf(sink.rdbuf());  // hide the account dumps
+  Bank *bank = new Bank(accounts, BANK_QUIET);
+
+  vector<thread> workers;
+  auto start = chrono::steady_clock::now();
+  for (int w = 0; w < threads; w++) {
+    workers.emplace_back([bank, w] {
+      minstd_rand rng(w);
+      for (int k = 0; k < ops; k++) bank->deposit(w, k, rng() % accounts, 1);
+    });
+  }
+  for (auto &t : workers) t.join();
+  double secs =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  delete bank;
+  cout.rdbuf(old);
+  return secs;
+}
+
+static void report(const char *name, double secs) {
+  long total = (long)threads * ops;
+  printf("%s,%d,%d,%ld,%.4f,%.0f\n", name, threads, accounts, total, secs,
+         total / secs);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1) threads = atoi(argv[1]);
+  if (argc > 2) accounts = atoi(argv[2]);
+  if (argc > 3) ops = atoi(argv[3]);
+  if (threads <= 0 || accounts <= 0 || ops <= 0) {
+    fprintf(stderr, "Usage: %s [threads] [accounts] [ops_per_thread]\n",
+            argv[0]);
+    return -1;
+  }
+
+  printf("counter,threads,accounts,ops,seconds,ops_per_sec\n");
+
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  int locked_count = 0;
+  report("global_lock", run([&](int) {
+           pthread_mutex_lock(&lock);
+           locked_count++;
+           pthread_mutex_unlock(&lock);
+         }));
+
+  atomic<long> shared_count{0};
+  report("global_atomic", run([&](int) {
+           shared_count.fetch_add(1, memory_order_relaxed);
+         }));
+
+  vector<CounterShard> shards(threads);
+  report("sharded", run([&](int w) {
+           shards[w].succ.fetch_add(1, memory_order_relaxed);
+         }));
+
+  report("bank", run_bank());
+  return 0;
+}
@@ -2,7 +2,11 @@
 #define _BANK_H
 
 #include <assert.h> /* for assert */
+#include <lockStats.h>
+#include <logSink.h>
+#include <wal.h>
 #include <pthread.h>
+#include <atomic>
 #include <shared_mutex>
 #include <semaphore.h> /* for sem */
 #include <stdlib.h>    /* for atoi() and exit() */
@@ -34,20 +38,79 @@ using namespace std;
 #define ERR \
   std::string { "[ FAIL ] " }
 
+// Bank construction flags.
+#define BANK_ASYNC_LOG 0x1  // log through a background LogSink, not cout
+#define BANK_QUIET 0x2      // count outcomes but do not log them
+#define BANK_PADDED 0x4     // one cache line (or more) per Account
+#define BANK_SOA 0x8        // balances and locks in separate arrays
+#define BANK_ATOMIC 0x10    // lock-free deposit/withdraw on atomic balances
+#define BANK_TIMED 0x20     // measure time spent waiting for account locks
+#define BANK_LAZY 0x40      // allocate accounts page by page on first touch
+
+#define ACCOUNT_PAGE_SHIFT 12
+#define ACCOUNT_PAGE (1 << ACCOUNT_PAGE_SHIFT)  // accounts per BANK_LAZY page
+
+#ifndef CACHE_LINE
+#define CACHE_LINE 64
+#endif
+
+#define COUNTER_SHARDS 64  // success/fail counter shards, indexed by workerID
+
+// Transaction kinds, for recordTxn().
+#define TXN_DEPOSIT 0
+#define TXN_WITHDRAW 1
+#define TXN_TRANSFER 2
+
 struct Account {
   unsigned int accountID;
-  long balance;
+  std::atomic<long> balance;
   pthread_mutex_t lock;
 };
 
+// One consumer's success/fail tally, alone on its cache line so that
+// consumers counting outcomes never write to a line another one owns.
+struct CounterShard {
+  alignas(CACHE_LINE) std::atomic<long> succ;
+  std::atomic<long> fail;
+  std::atomic<long> wait_ns;  // account lock wait, with BANK_TIMED
+};
+
 class Bank {
  private:
   int num;
-  int num_succ;
-  int num_fail;
+  CounterShard *counters;  // COUNTER_SHARDS shards, summed on read
+  int flags;
+  LogSink *sink;  // only with BANK_ASYNC_LOG
+  WriteAheadLog *wal;  // NULL unless setWal() was called; not owned
+
+  // Account storage: an array of Accounts `stride` bytes apart in `slab`,
+  // or, with BANK_SOA, one array per field.
+  char *slab;
+  size_t stride;
+  std::atomic<long> *soa_balance;
+  pthread_mutex_t *soa_lock;
+
+  // With BANK_LAZY, `slab` is unused: account i lives in page
+  // i / ACCOUNT_PAGE, allocated by the first thread that touches it.
+  std::atomic<char *> *pages;
+  int num_pages;
+
+  // With stripes > 0, account i is guarded by stripe_lock[i % stripes]
+  // instead of its own mutex.
+  pthread_mutex_t *stripe_lock;
+  int stripes;
+
+  char *touchPage(int page);
+  void initAccounts(char *base, int first, int n);
+
+  void count(int workerID, bool ok);
+  void credit(int accountID, long amount);
+  bool debit(int accountID, long amount);
+  void recordTxn(bool ok, int kind, int workerID, int ledgerID, int accountID,
+                 int otherID, long amount, bool counted = true);
 
  public:
-  Bank(int N);
+  Bank(int N, int flags = 0, int stripes = 0);
   ~Bank();  // destructor
 
   int deposit(int workerID, int ledgerID, int accountID, int amount);
@@ -55,16 +118,73 @@ class Bank {
   int transfer(int workerID, int ledgerID, int src_id, int dest_id,
                unsigned int amount);
 
+  // Lock-free variants for threads that own the accounts they touch. With
+  // counted == false the outcome is logged but left for countBatch().
+  int depositLocal(int workerID, int ledgerID, int accountID, int amount,
+                   bool counted = true);
+  int withdrawLocal(int workerID, int ledgerID, int accountID, int amount,
+                    bool counted = true);
+  int transferLocal(int workerID, int ledgerID, int src_id, int dest_id,
+                    unsigned int amount, bool counted = true);
+  int transferOut(int workerID, int ledgerID, int src_id, int dest_id,
+                  unsigned int amount, bool counted = true);
+  void countBatch(int workerID, long succ, long fail);
+
+  // Durable mode: every outcome is also appended to `wal`.
+  void setWal(WriteAheadLog *log) { wal = log; }
+  void syncWal() {
+    if (wal != NULL) checkWal(wal->sync());
+  }
+  void syncWalAll() {
+    if (wal != NULL) checkWal(wal->syncAll());
+  }
+  void checkWal(int err);
+  void replay(const WalRecord &r);
+  void lockAccount(int workerID, int accountID);
+  void unlockAccount(int accountID);
+  void transferIn(int dest_id, unsigned int amount);
+
   // helper functions
   void print_account();
   void recordSucc(string message);
   void recordFail(string message);
+  void flushLog();
   int getNum() { return num; }
-  int getNumSucc() { return num_succ; }
-  int getNumFail() { return num_fail; }
+  int getNumSucc();
+  int getNumFail();
+  long getLockWaitNs();
+  long totalBalance();
+
+  // Field accessors; valid for every account layout.
+  Account *accountAt(int accountID) {
+    if (pages == NULL) return (Account *)(slab + (size_t)accountID * stride);
+    char *page = pages[accountID >> ACCOUNT_PAGE_SHIFT].load(
+        std::memory_order_acquire);
+    if (page == NULL) page = touchPage(accountID >> ACCOUNT_PAGE_SHIFT);
+    return (Account *)(page + (size_t)(accountID & (ACCOUNT_PAGE - 1)) * stride);
+  }
+  std::atomic<long> &balanceOf(int accountID) {
+    if (soa_balance != NULL) return soa_balance[accountID];
+    return accountAt(accountID)->balance;
+  }
+  pthread_mutex_t *lockOf(int accountID) {
+    if (stripe_lock != NULL) return &stripe_lock[lockIndex(accountID)];
+    if (soa_lock != NULL) return &soa_lock[accountID];
+    return &accountAt(accountID)->lock;
+  }
+  // Accounts with the same lock index share a lock. Locks are always taken
+  // in ascending lock index order.
+  int lockIndex(int accountID) {
+    return stripe_lock != NULL ? accountID % stripes : accountID;
+  }
+  // False for accounts on a BANK_LAZY page nobody has touched yet.
+  bool exists(int accountID) {
+    return pages == NULL ||
+           pages[accountID >> ACCOUNT_PAGE_SHIFT].load(
+               std::memory_order_acquire) != NULL;
+  }
 
   pthread_mutex_t bank_lock;
-  struct Account *accounts;
 };
 
 #endif
\ No newline at end of file
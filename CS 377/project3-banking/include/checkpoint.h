@@ -0,0 +1,43 @@
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+
+#include <bank.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Snapshot file layout: a SnapshotHeader followed by `count` records of
+// (int32 account, int32 pad, int64 balance), ascending by account. Accounts
+// with a zero balance are left out, so the file grows with the active
+// accounts only.
+#define SNAPSHOT_MAGIC "BSNP"
+#define SNAPSHOT_VERSION 1
+
+struct SnapshotHeader {
+  char magic[4];         // SNAPSHOT_MAGIC
+  uint32_t version;      // SNAPSHOT_VERSION
+  int64_t last_ledger;   // every entry up to this ledgerID is applied
+  int64_t succ;          // success count at that point
+  int64_t fail;          // failure count at that point
+  int32_t accounts;      // bank size
+  int32_t pad;
+  uint64_t count;        // number of balance records
+};
+
+// Bank state after a prefix of the ledger.
+struct Snapshot {
+  int64_t last_ledger;
+  long succ;
+  long fail;
+  int accounts;
+  vector<pair<int, long>> balances;  // nonzero balances, ascending by ID
+};
+
+void capture_snapshot(Bank *bank, int64_t last_ledger, Snapshot &out);
+int write_snapshot(const char *filename, const Snapshot &snap);
+int read_snapshot(const char *filename, Snapshot &out);
+int apply_snapshot(Bank *bank, const Snapshot &snap);
+
+#endif
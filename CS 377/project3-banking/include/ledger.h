@@ -3,6 +3,9 @@
 
 #include <bank.h>
 #include <boundedBuffer.h>
+#include <time.h>
+#include <unordered_map>
+#include <vector>
 
 #ifdef DEBUGMODE
 #define debug(msg) \
@@ -17,8 +20,17 @@ using namespace std;
 #define W 1
 #define T 2
 
+// Execution modes (Options::exec_mode).
+#define EXEC_SHARED 0   // producers -> one shared buffer -> any consumer
+#define EXEC_SHARDED 1  // consumer s owns accounts acc % c == s
+#define EXEC_DETERMINISTIC 2  // conflict DAG per window, same result as serial
+
+#define DET_WINDOW 4096  // ledger entries scheduled per DAG in EXEC_DETERMINISTIC
+
 const int SEED_RANDOM = 377;
 
+class LedgerStream;
+
 struct Ledger {
   int acc;
   int other;
@@ -27,15 +39,81 @@ struct Ledger {
   int ledgerID;
 };
 
-extern list<struct Ledger *> ledger;
+// Run-time knobs. main() fills these in from the command line before calling
+// InitBank(); the defaults reproduce the original behaviour.
+struct Options {
+  int bb_mode;  // BB_MUTEX or BB_LOCKFREE
+  int batch;    // max entries moved per buffer operation (>= 1)
+  int bank_flags;  // BANK_* flags passed to the Bank constructor
+  int load_threads;  // ledger parser threads, 0 = one per CPU
+  int exec_mode;     // EXEC_SHARED, EXEC_SHARDED or EXEC_DETERMINISTIC
+  int group_commit;  // EXEC_SHARED consumers apply batches grouped by account
+  int accounts;      // bank size, 0 = largest account ID in the ledger + 1
+  int stripes;       // account lock stripes, 0 = one lock per account
+  const char *checkpoint_file;  // EXEC_DETERMINISTIC snapshots, NULL = none
+  long checkpoint_every;        // entries between snapshots
+  const char *restore_file;     // snapshot to resume from, NULL = none
+  const char *wal_file;         // write-ahead log, NULL = not durable
+  int wal_level;                // WAL_ASYNC, WAL_GROUP or WAL_SYNC
+  int wal_interval_us;          // longest a record waits for its group
+  int stream;  // parse the ledger while it runs instead of loading it first
+};
+
+// A producer's share of ledger_arena, [begin, end) packed into one word
+// (end in the high half) so the owner and thieves can update it with CAS.
+struct LedgerRange {
+  alignas(CACHE_LINE) std::atomic<uint64_t> span;
+};
+
+static inline uint64_t pack_range(uint32_t begin, uint32_t end) {
+  return (uint64_t)end << 32 | begin;
+}
+static inline uint32_t range_begin(uint64_t span) { return (uint32_t)span; }
+static inline uint32_t range_end(uint64_t span) { return span >> 32; }
+
+extern vector<struct Ledger> ledger_arena;
+extern LedgerRange *ranges;
+extern int num_ranges;
 extern Bank *bank;
 extern BoundedBuffer<struct Ledger*> *bb; 
 extern int max_items;
 extern int con_items;
+extern struct Options opts;
+
+// Per-entry timestamps (ns, indexed like ledger_arena) for benchmarks:
+// when run_shared() handed the entry to the buffer and when it was applied.
+// NULL, the default, turns tracing off.
+extern uint64_t *trace_enqueue;
+extern uint64_t *trace_done;
+
+static inline uint64_t trace_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
 void InitBank(int np, int nc, int size, char *filename);
 int load_ledger(char *filename);
+void ledger_account_range(int *lo, int *hi);
+void skip_applied(int64_t last);
+WriteAheadLog *recover_wal(int64_t after);
+void run_shared(int p, int c, int size);
+void run_sharded(int p, int c, int size);
+void run_deterministic(int p, int c, int size);
+void run_stream(int p, int c, int size, LedgerStream *stream);
+// Per-consumer scratch space for commit_groups().
+struct GroupScratch {
+  unordered_map<int, int> parent;  // absent = its own root
+  int find(int a);
+  void unite(int a, int b);
+};
+
+void commit_groups(int workerID, struct Ledger **batch, int n,
+                   GroupScratch &scratch);
+void process_entry(int workerID, struct Ledger *entry);
 void *consumer(void *workerID);
-void *producer(void *unused);
+void *producer(void *producerID);
+void *stream_consumer(void *workerID);
+void *stream_producer(void *producerID);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,84 @@
+#ifndef _LEDGERFILE_H
+#define _LEDGERFILE_H
+
+#include <ledger.h>
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+// Text files smaller than this per thread are parsed on fewer threads.
+#define LOAD_MIN_CHUNK (1 << 20)
+
+// Bytes LedgerStream reads from its file per refill.
+#define LEDGER_STREAM_CHUNK (64 << 10)
+
+// Binary ledger layout: a LedgerFileHeader followed by four columns, each
+// starting on an 8-byte boundary:
+//   acc[count], other[count]  account IDs, `id_bytes` wide each
+//   amount[count]             int32
+//   mode[count]               uint8
+// Without LEDGER_DELTA an ID is stored as the unsigned offset id - id_base.
+// With it, each ID is stored as the signed difference to the previous ID
+// of the same column (the first one to id_base), which keeps the columns
+// narrow when neighbouring entries hit nearby accounts.
+//
+// min_acc/max_acc are the accounts the ledger touches, counting `other`
+// only for transfers, as a scan of a text ledger does. id_base is the
+// smallest ID in either column, unused `other`s included.
+#define LEDGER_MAGIC "LDGB"
+#define LEDGER_VERSION 1
+#define LEDGER_DELTA 0x1
+
+struct LedgerFileHeader {
+  char magic[4];     // LEDGER_MAGIC
+  uint16_t version;  // LEDGER_VERSION
+  uint16_t flags;    // LEDGER_DELTA or 0
+  uint8_t id_bytes;  // width of the acc/other columns: 1, 2 or 4
+  uint8_t pad[3];
+  int32_t id_base;   // what IDs are stored relative to
+  uint64_t count;    // number of records
+  int32_t min_acc;   // smallest account ID touched
+  int32_t max_acc;   // largest account ID touched
+};
+
+bool is_binary_ledger(const char *data, size_t len);
+int decode_ledger_binary(const char *data, size_t len,
+                         vector<struct Ledger> &out,
+                         struct LedgerFileHeader *header);
+int write_ledger_binary(const char *filename, const vector<struct Ledger> &rows,
+                        bool delta);
+int write_ledger_text(const char *filename, const vector<struct Ledger> &rows);
+int parse_ledger_text(const char *data, size_t len, vector<struct Ledger> &out,
+                      int threads);
+int read_ledger_file(const char *filename, vector<struct Ledger> &out,
+                     int threads, struct LedgerFileHeader *header = NULL);
+
+// Incremental reader for a text ledger that may not fit in memory or may
+// not have ended yet: a regular file, a FIFO, or stdin ("-"). Entries come
+// out in file order with ledgerIDs from 0, exactly as read_ledger_file()
+// would number them. next() is safe to call from several threads.
+class LedgerStream {
+ public:
+  LedgerStream(const char *filename);
+  ~LedgerStream();
+
+  bool ok() { return fd >= 0; }
+  int next(struct Ledger *out, int max);
+
+ private:
+  bool fill();
+
+  int fd;
+  bool owns_fd;  // false for stdin
+  char *buf;
+  size_t cap;
+  size_t pos;   // first unparsed byte
+  size_t len;   // bytes held in buf
+  bool eof;     // read() returned 0
+  bool done;    // nothing more will be parsed
+  int next_id;
+  pthread_mutex_t lock;
+};
+
+#endif
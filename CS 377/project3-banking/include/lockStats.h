@@ -0,0 +1,62 @@
+#ifndef _LOCKSTATS_H
+#define _LOCKSTATS_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <iostream>
+
+using namespace std;
+
+// Lock classes, for the STAT_* macros below.
+#define LOCK_CLASS_BUFFER 0   // BoundedBuffer::buffer_lock
+#define LOCK_CLASS_BANK 1     // Bank::bank_lock
+#define LOCK_CLASS_LEDGER 2   // ledger_lock
+#define LOCK_CLASS_ACCOUNT 3  // Account::lock, also tracked per account
+#define LOCK_CLASSES 4
+
+#define LOCK_STATS_ACCOUNTS 1024  // accounts tracked individually
+#define LOCK_STATS_HELD 64        // locks one thread can hold and still time
+
+// A snapshot of one lock class's (or one account's) counters.
+struct LockStat {
+  long acquired;   // lock acquisitions
+  long contended;  // acquisitions that had to wait
+  long wait_ns;    // total time spent waiting
+  long max_wait_ns;
+  long hold_ns;    // total time held
+};
+
+void stat_lock(pthread_mutex_t *lock, int cls, int account);
+int stat_trylock(pthread_mutex_t *lock, int cls, int account);
+void stat_unlock(pthread_mutex_t *lock, int cls, int account);
+int stat_cond_wait(pthread_cond_t *cond, pthread_mutex_t *lock, int cls,
+                   int account);
+LockStat lock_stats_class(int cls);
+LockStat lock_stats_account(int account);
+void lock_stats_reset();
+void lock_stats_report(ostream &out);
+
+/*
+ * Build with -DLOCK_STATS (make LOCKSTATS=-DLOCK_STATS) to route the locks
+ * of the bank, the bounded buffer and the ledger through stat_lock() and
+ * friends. Without it the macros are the plain pthread calls and cost
+ * nothing.
+ */
+#ifdef LOCK_STATS
+#define STAT_LOCK(lock, cls, account) stat_lock(lock, cls, account)
+#define STAT_TRYLOCK(lock, cls, account) stat_trylock(lock, cls, account)
+#define STAT_UNLOCK(lock, cls, account) stat_unlock(lock, cls, account)
+#define STAT_COND_WAIT(cond, lock, cls, account) \
+  stat_cond_wait(cond, lock, cls, account)
+#define LOCK_STATS_RESET() lock_stats_reset()
+#define LOCK_STATS_REPORT(out) lock_stats_report(out)
+#else
+#define STAT_LOCK(lock, cls, account) pthread_mutex_lock(lock)
+#define STAT_TRYLOCK(lock, cls, account) pthread_mutex_trylock(lock)
+#define STAT_UNLOCK(lock, cls, account) pthread_mutex_unlock(lock)
+#define STAT_COND_WAIT(cond, lock, cls, account) pthread_cond_wait(cond, lock)
+#define LOCK_STATS_RESET()
+#define LOCK_STATS_REPORT(out)
+#endif
+
+#endif
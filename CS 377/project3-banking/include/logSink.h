@@ -0,0 +1,51 @@
+#ifndef _LOGSINK_H
+#define _LOGSINK_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <atomic>
+#include <iostream>
+
+using namespace std;
+
+#define LOG_BUFFER_SIZE (64 * 1024)  // bytes of pending log text per thread
+#define LOG_LINE_MAX 160             // longest line post() will accept
+
+/**
+ * Asynchronous line sink. Every posting thread gets its own single-producer
+ * byte ring, so post() never takes a lock; a background writer thread drains
+ * the rings into `out` and flushes only when it runs out of work.
+ *
+ * Lines from one thread come out in the order they were posted. Lines from
+ * different threads may interleave in any order, but never mid-line.
+ */
+class LogSink {
+ public:
+  LogSink(ostream &out);
+  ~LogSink();  // drains everything posted so far, then stops the writer
+
+  void post(const char *line, int len);
+  void flush();  // returns once the caller's earlier posts reached `out`
+
+ private:
+  struct ThreadBuffer {
+    alignas(64) std::atomic<size_t> head;  // advanced by the writer
+    alignas(64) std::atomic<size_t> tail;  // advanced by the owning thread
+    ThreadBuffer *next;
+    char data[LOG_BUFFER_SIZE];
+  };
+
+  ThreadBuffer *local();
+  bool drain();
+  static void *writer(void *sink);
+
+  ostream &out;
+  uint64_t id;
+  std::atomic<ThreadBuffer *> buffers;  // push-only registry of rings
+  std::atomic<bool> stop;
+  std::atomic<uint64_t> flush_req;
+  std::atomic<uint64_t> flush_ack;
+  pthread_t thread;
+};
+
+#endif
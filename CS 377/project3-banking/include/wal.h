@@ -0,0 +1,89 @@
+#ifndef _WAL_H
+#define _WAL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+using namespace std;
+
+// Durability levels.
+#define WAL_ASYNC 0  // written by the flusher, never fsync()ed
+#define WAL_GROUP 1  // fsync()ed by the flusher every interval; no waiting
+#define WAL_SYNC 2   // sync() waits until the caller's records are on disk
+
+#define WAL_GROUP_BYTES (256 * 1024)  // flush early once a group is this big
+
+// WAL file layout: an 8-byte header ("BWAL", uint32 version) followed by
+// WalRecords in the order they were appended. A record whose checksum does
+// not match ends the log (a torn write from a crash).
+#define WAL_MAGIC "BWAL"
+#define WAL_VERSION 1
+
+// One applied transaction, as recordTxn() saw it.
+struct WalRecord {
+  int32_t ledgerID;
+  int32_t acc;
+  int32_t other;
+  int32_t amount;
+  uint8_t kind;  // TXN_DEPOSIT, TXN_WITHDRAW or TXN_TRANSFER
+  uint8_t ok;
+  uint16_t pad;
+  uint32_t check;  // wal_checksum() of the fields above
+};
+
+uint32_t wal_checksum(const WalRecord &r);
+int read_wal(const char *filename, vector<WalRecord> &out);
+
+/**
+ * Append-only binary log of applied transactions with group commit.
+ *
+ * append() copies a record into the current group under a short mutex. A
+ * flusher thread swaps the group out, write()s it and, unless the level is
+ * WAL_ASYNC, fsync()s it once for every record in it. With WAL_SYNC,
+ * sync() blocks the caller until its own last record is durable; callers
+ * that sync at the same time share one fsync. syncAll() does the same for
+ * every thread's records, for a caller that syncs on the others' behalf.
+ *
+ * A failed write or fsync is sticky: the records are not counted as
+ * written, nothing more is written, and sync(), syncAll() and flush()
+ * return the errno (at every level) instead of 0 from then on.
+ */
+class WriteAheadLog {
+ public:
+  WriteAheadLog(const char *filename, int level, int interval_us);
+  ~WriteAheadLog();  // flushes and syncs everything appended so far
+
+  bool ok() { return fd >= 0; }
+  void append(const WalRecord &r);
+  int sync();
+  int syncAll();
+  int flush();
+  int getError() { return error.load(std::memory_order_relaxed); }
+  long getGroups() { return groups; }
+
+ private:
+  static void *flusher(void *wal);
+  int waitFor(uint64_t lsn);
+
+  int fd;
+  int level;
+  int interval_us;
+  uint64_t id;
+
+  pthread_mutex_t lock;
+  pthread_cond_t work;     // signals the flusher
+  pthread_cond_t durable;  // signals sync() waiters
+  vector<char> active;     // group being filled
+  vector<char> flushing;   // group being written
+  uint64_t appended;       // records appended so far
+  uint64_t synced;         // records written (and synced) so far
+  std::atomic<int> error;  // errno of the first failed write or fsync
+  int waiters;
+  bool stop;
+  long groups;
+  pthread_t thread;
+};
+
+#endif
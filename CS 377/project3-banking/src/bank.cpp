@@ -1,51 +1,380 @@
 #include <bank.h>
+#include <stdlib.h>
+#include <string.h>
 
 /**
  * @brief prints account information
  */
 void Bank::print_account() {
   for (int i = 0; i < num; i++) {
-    pthread_mutex_lock(&accounts[i].lock);
-    cout << "ID# " << accounts[i].accountID << " | " << accounts[i].balance
+    if (!exists(i)) {  // BANK_LAZY: a page nobody touched, all 0
+      i |= ACCOUNT_PAGE - 1;
+      continue;
+    }
+    pthread_mutex_lock(lockOf(i));
+    cout << "ID# " << i << " | " << balanceOf(i)
          << endl;
-    pthread_mutex_unlock(&accounts[i].lock);
+    pthread_mutex_unlock(lockOf(i));
   }
 
   pthread_mutex_lock(&bank_lock);
-  cout << "Success: " << num_succ << " Fails: " << num_fail << endl;
+  cout << "Success: " << getNumSucc() << " Fails: " << getNumFail() << endl;
   pthread_mutex_unlock(&bank_lock);
 }
 
 /**
- * @brief helper function to increment the bank variable `num_fail` and log
- *        message.
+ * @brief helper function to count a failure and log message.
+ *
+ * The failure lands in counter shard 0; callers that know their worker ID
+ * go through recordTxn() instead.
  *
  * @param message
  */
 void Bank::recordFail(string message) {
   pthread_mutex_lock(&bank_lock);
   cout << message << endl;
-  num_fail++;
   pthread_mutex_unlock(&bank_lock);
+  count(0, false);
 }
 
 /**
- * @brief helper function to increment the bank variable `num_succ` and log
- *        message.
+ * @brief helper function to count a success and log message.
+ *
+ * The success lands in counter shard 0; callers that know their worker ID
+ * go through recordTxn() instead.
  *
  * @param message
  */
 void Bank::recordSucc(string message) {
   pthread_mutex_lock(&bank_lock);
   cout << message << endl;
-  num_succ++;
   pthread_mutex_unlock(&bank_lock);
+  count(0, true);
 }
 
 /***************************************************
  * DO NOT MODIFY ABOVE CODE
  ****************************************************/
 
+/**
+ * @brief Appends the decimal form of `v` at `p`.
+ *
+ * @return A pointer just past the last digit written.
+ */
+static char *put_int(char *p, long v) {
+  char tmp[24];
+  int n = 0;
+  unsigned long u = v < 0 ? 0UL - (unsigned long)v : (unsigned long)v;
+  do {
+    tmp[n++] = '0' + u % 10;
+    u /= 10;
+  } while (u != 0);
+  if (v < 0) *p++ = '-';
+  while (n > 0) *p++ = tmp[--n];
+  return p;
+}
+
+static char *put_str(char *p, const char *s, size_t len) {
+  memcpy(p, s, len);
+  return p + len;
+}
+
+#define PUT_LIT(p, lit) put_str(p, lit, sizeof(lit) - 1)
+
+/**
+ * @brief Formats a transaction log line straight into `buf`.
+ *
+ * Produces exactly the text of the DEPOSIT_MSG/WITHDRAW_MSG/TRANSFER_MSG
+ * macros with SUCC or ERR, followed by a newline, without building any
+ * std::string.
+ *
+ * @return The number of bytes written; `buf` needs LOG_LINE_MAX bytes.
+ */
+static int format_txn(char *buf, bool ok, int kind, int workerID,
+                      int ledgerID, int accountID, int otherID, long amount) {
+  char *p = buf;
+  p = ok ? PUT_LIT(p, "[ SUCCESS ] ") : PUT_LIT(p, "[ FAIL ] ");
+  p = PUT_LIT(p, "TID: ");
+  p = put_int(p, workerID);
+  p = PUT_LIT(p, ", LID: ");
+  p = put_int(p, ledgerID);
+  p = PUT_LIT(p, ", Acc: ");
+  p = put_int(p, accountID);
+  if (kind == TXN_DEPOSIT) {
+    p = PUT_LIT(p, " DEPOSIT $");
+  } else if (kind == TXN_WITHDRAW) {
+    p = PUT_LIT(p, " WITHDRAW $");
+  } else {
+    p = PUT_LIT(p, " TRANSFER $");
+  }
+  p = put_int(p, amount);
+  if (kind == TXN_TRANSFER) {
+    p = PUT_LIT(p, " TO Acc: ");
+    p = put_int(p, otherID);
+  }
+  *p++ = '\n';
+  return p - buf;
+}
+
+/**
+ * @brief Logs and counts one transaction outcome.
+ *
+ * @details
+ * Without BANK_ASYNC_LOG this builds the message with the *_MSG macros and
+ * writes it to cout under bank_lock, as recordSucc()/recordFail() do. With
+ * it, the line is preformatted on the stack and posted to the calling
+ * thread's LogSink ring; no lock is taken. BANK_QUIET skips the log line
+ * altogether. Either way the outcome is counted in the worker's own
+ * counter shard. With a WAL attached the outcome is appended to it first,
+ * and nothing is reported once the log has failed (see checkWal()).
+ *
+ * @param ok Whether the transaction succeeded.
+ * @param kind TXN_DEPOSIT, TXN_WITHDRAW or TXN_TRANSFER.
+ * @param otherID The destination account (transfers only).
+ * @param amount The amount, as the *_MSG macros would print it.
+ * @param counted False if the caller tallies outcomes itself and reports
+ * them through countBatch().
+ */
+void Bank::recordTxn(bool ok, int kind, int workerID, int ledgerID,
+                     int accountID, int otherID, long amount, bool counted) {
+  if (counted) count(workerID, ok);
+  if (wal != NULL) {
+    wal->append(WalRecord{ledgerID, accountID, otherID, (int32_t)amount,
+                          (uint8_t)kind, ok, 0, 0});
+    checkWal(wal->getError());
+  }
+  if (flags & BANK_QUIET) {
+    return;
+  }
+
+  if (sink == NULL) {
+    string level = ok ? SUCC : ERR;
+    string message;
+    if (kind == TXN_DEPOSIT) {
+      message = DEPOSIT_MSG(level, workerID, ledgerID, accountID, (int)amount);
+    } else if (kind == TXN_WITHDRAW) {
+      message = WITHDRAW_MSG(level, workerID, ledgerID, accountID, (int)amount);
+    } else {
+      message = TRANSFER_MSG(level, workerID, ledgerID, accountID, otherID,
+                             (unsigned int)amount);
+    }
+    STAT_LOCK(&bank_lock, LOCK_CLASS_BANK, -1);
+    cout << message << endl;
+    STAT_UNLOCK(&bank_lock, LOCK_CLASS_BANK, -1);
+    return;
+  }
+
+  char line[LOG_LINE_MAX];
+  int len = format_txn(line, ok, kind, workerID, ledgerID, accountID, otherID,
+                       amount);
+  sink->post(line, len);
+}
+
+/**
+ * @brief Stops the process if the WAL could not write or sync a record.
+ *
+ * Past that point transactions can no longer be made durable, so no
+ * outcome may be reported as committed: the error is printed and the
+ * process aborts, leaving the log ending at its last good record.
+ *
+ * @param err 0, or the errno a WriteAheadLog call returned.
+ */
+void Bank::checkWal(int err) {
+  if (err == 0) return;
+  pthread_mutex_lock(&bank_lock);
+  cout << "ERR: WAL FAILED: " << strerror(err) << endl;
+  abort();
+}
+
+/**
+ * @brief Counts one outcome in the shard owned by `workerID`.
+ *
+ * Consumers with distinct IDs (modulo COUNTER_SHARDS) never touch the same
+ * cache line, so counting costs an uncontended relaxed increment.
+ */
+void Bank::count(int workerID, bool ok) {
+  CounterShard &shard = counters[(unsigned)workerID % COUNTER_SHARDS];
+  (ok ? shard.succ : shard.fail).fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Adds a whole batch's outcomes to the worker's counter shard at
+ * once, for callers that applied it with `counted == false`.
+ */
+void Bank::countBatch(int workerID, long succ, long fail) {
+  CounterShard &shard = counters[(unsigned)workerID % COUNTER_SHARDS];
+  if (succ > 0) shard.succ.fetch_add(succ, std::memory_order_relaxed);
+  if (fail > 0) shard.fail.fetch_add(fail, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Re-applies a logged outcome during recovery: the balance changes
+ * of a successful transaction, without any checks, and its count.
+ *
+ * Successful effects only ever add or subtract fixed amounts, so replaying
+ * a log in its own order gives the balances the run had, whatever order
+ * the consumers applied them in. Not thread-safe; call before any consumer
+ * starts.
+ */
+void Bank::replay(const WalRecord &r) {
+  if (r.ok) {
+    if (r.kind == TXN_DEPOSIT) {
+      credit(r.acc, r.amount);
+    } else if (r.kind == TXN_WITHDRAW) {
+      credit(r.acc, -(long)r.amount);
+    } else {
+      credit(r.acc, -(long)(unsigned)r.amount);
+      credit(r.other, (unsigned)r.amount);
+    }
+  }
+  count(0, r.ok);
+}
+
+/**
+ * @brief Locks an account. With BANK_TIMED, a lock that is not free on the
+ * first try is timed and the wait is added to the worker's counter shard;
+ * a free one costs no clock reads.
+ */
+void Bank::lockAccount(int workerID, int accountID) {
+  pthread_mutex_t *lock = lockOf(accountID);
+  if (!(flags & BANK_TIMED)) {
+    STAT_LOCK(lock, LOCK_CLASS_ACCOUNT, accountID);
+    return;
+  }
+
+  if (STAT_TRYLOCK(lock, LOCK_CLASS_ACCOUNT, accountID) == 0) {
+    return;
+  }
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  STAT_LOCK(lock, LOCK_CLASS_ACCOUNT, accountID);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  long ns = (end.tv_sec - start.tv_sec) * 1000000000L +
+            (end.tv_nsec - start.tv_nsec);
+  counters[(unsigned)workerID % COUNTER_SHARDS].wait_ns.fetch_add(
+      ns, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Unlocks an account locked with lockAccount().
+ */
+void Bank::unlockAccount(int accountID) {
+  STAT_UNLOCK(lockOf(accountID), LOCK_CLASS_ACCOUNT, accountID);
+}
+
+/**
+ * @brief Sums the account lock wait time of all shards (BANK_TIMED only).
+ *
+ * @return The total wait in nanoseconds.
+ */
+long Bank::getLockWaitNs() {
+  long ns = 0;
+  for (int i = 0; i < COUNTER_SHARDS; i++) {
+    ns += counters[i].wait_ns.load(std::memory_order_relaxed);
+  }
+  return ns;
+}
+
+/**
+ * @brief Sums the success counts of all shards.
+ */
+int Bank::getNumSucc() {
+  long n = 0;
+  for (int i = 0; i < COUNTER_SHARDS; i++) {
+    n += counters[i].succ.load(std::memory_order_relaxed);
+  }
+  return n;
+}
+
+/**
+ * @brief Sums the failure counts of all shards.
+ */
+int Bank::getNumFail() {
+  long n = 0;
+  for (int i = 0; i < COUNTER_SHARDS; i++) {
+    n += counters[i].fail.load(std::memory_order_relaxed);
+  }
+  return n;
+}
+
+/**
+ * @brief Adds `amount` to an account's balance.
+ *
+ * The caller holds the account lock unless BANK_ATOMIC is set. Under the
+ * lock a plain (relaxed) load and store is enough and avoids a locked
+ * instruction; without it the update is a single atomic fetch_add.
+ */
+void Bank::credit(int accountID, long amount) {
+  std::atomic<long> &balance = balanceOf(accountID);
+  if (flags & BANK_ATOMIC) {
+    balance.fetch_add(amount, std::memory_order_relaxed);
+  } else {
+    balance.store(balance.load(std::memory_order_relaxed) + amount,
+                  std::memory_order_relaxed);
+  }
+}
+
+/**
+ * @brief Takes `amount` out of an account if the balance covers it.
+ *
+ * Same locking contract as credit(). In BANK_ATOMIC mode the sufficient
+ * funds check and the subtraction are one compare-and-swap, retried while
+ * the balance still covers the amount.
+ *
+ * @return true if the balance was reduced, false for insufficient funds.
+ */
+bool Bank::debit(int accountID, long amount) {
+  std::atomic<long> &balance = balanceOf(accountID);
+  long current = balance.load(std::memory_order_relaxed);
+  if (!(flags & BANK_ATOMIC)) {
+    if (current < amount) return false;
+    balance.store(current - amount, std::memory_order_relaxed);
+    return true;
+  }
+  while (current >= amount) {
+    if (balance.compare_exchange_weak(current, current - amount,
+                                      std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Sums every account balance without taking account locks.
+ *
+ * This is a plain scan meant for reporting and benchmarks; while consumers
+ * are running the result is not a consistent snapshot.
+ */
+long Bank::totalBalance() {
+  long total = 0;
+  if (soa_balance != NULL) {
+    for (int i = 0; i < num; i++) {
+      total += soa_balance[i].load(std::memory_order_relaxed);
+    }
+  } else {
+    for (int i = 0; i < num; i++) {
+      if (!exists(i)) {  // skip the rest of an untouched page
+        i |= ACCOUNT_PAGE - 1;
+        continue;
+      }
+      total += balanceOf(i).load(std::memory_order_relaxed);
+    }
+  }
+  return total;
+}
+
+/**
+ * @brief Blocks until every log line this thread produced has been written.
+ *
+ * A no-op without BANK_ASYNC_LOG, where lines are written synchronously.
+ */
+void Bank::flushLog() {
+  if (sink != NULL) {
+    sink->flush();
+  }
+}
+
 /**
  * @brief Construct a new Bank object.
  *
@@ -57,21 +386,75 @@ void Bank::recordSucc(string message) {
  * to ensure thread safety during concurrent operations.
  *
  *
+ * How the accounts are laid out in memory depends on `flags`:
+ *   - default: an array of Account structs, packed back to back.
+ *   - BANK_PADDED: the same array, but each Account is padded to a whole
+ *     number of cache lines so neighbouring accounts never false-share.
+ *   - BANK_SOA: separate balance and lock arrays, so scans over balances
+ *     (print_account(), totalBalance()) touch only balance bytes.
+ *   - BANK_LAZY: packed or padded Accounts in pages of ACCOUNT_PAGE, each
+ *     allocated when one of its accounts is first touched, so memory follows
+ *     the active accounts rather than N. BANK_SOA is ignored.
+ *
+ * With `stripes` > 0, account i is guarded by lock stripe i % stripes and
+ * the per-account mutexes are never initialized.
+ *
+ * Success/failure counts live in COUNTER_SHARDS cache-line padded shards
+ * rather than behind bank_lock. With BANK_ASYNC_LOG in `flags`, transaction
+ * logs go through a LogSink whose writer thread owns cout, instead of being
+ * written under bank_lock; BANK_QUIET drops them.
+ *
  * @param N The number of accounts to be created in the bank.
+ * @param flags A bitwise OR of BANK_* flags (0 for the default behaviour).
+ * @param stripes The number of lock stripes, or 0 for one lock per account.
  */
-Bank::Bank(int N) {
+Bank::Bank(int N, int flags, int stripes) : flags(flags), stripes(stripes) {
   pthread_mutex_init(&bank_lock, NULL);
+  LOCK_STATS_RESET();
   num = N;
-  num_succ = 0;
-  num_fail = 0;
+  counters = new CounterShard[COUNTER_SHARDS];
+  for (int i = 0; i < COUNTER_SHARDS; i++) {
+    counters[i].succ = 0;
+    counters[i].fail = 0;
+    counters[i].wait_ns = 0;
+  }
+  sink = (flags & BANK_ASYNC_LOG) ? new LogSink(cout) : NULL;
+  wal = NULL;
 
-  accounts = new Account[N];
+  slab = NULL;
+  soa_balance = NULL;
+  soa_lock = NULL;
+  pages = NULL;
+  num_pages = 0;
+  stripe_lock = NULL;
+  if (stripes > 0) {
+    stripe_lock = new pthread_mutex_t[stripes];
+    for (int i = 0; i < stripes; i++) pthread_mutex_init(&stripe_lock[i], NULL);
+  }
 
-  for(int i = 0; i < num; i ++){
-    accounts[i].accountID = i; 
-    accounts[i].balance = 0;
-    pthread_mutex_init(&accounts[i].lock,NULL); 
-  }   
+  // Padded accounts start on a line boundary and fill whole lines, so no
+  // two accounts ever share one.
+  stride = sizeof(Account);
+  if (flags & BANK_PADDED) {
+    stride = (stride + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+  }
+
+  if (flags & BANK_LAZY) {
+    num_pages = (N + ACCOUNT_PAGE - 1) / ACCOUNT_PAGE;
+    pages = new std::atomic<char *>[num_pages];
+    for (int p = 0; p < num_pages; p++) pages[p].store(NULL);
+  } else if (flags & BANK_SOA) {
+    soa_balance = new std::atomic<long>[N];
+    if (stripe_lock == NULL) soa_lock = new pthread_mutex_t[N];
+    for (int i = 0; i < num; i++) {
+      soa_balance[i].store(0, std::memory_order_relaxed);
+      if (soa_lock != NULL) pthread_mutex_init(&soa_lock[i], NULL);
+    }
+  } else {
+    size_t bytes = ((size_t)N * stride + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    slab = (char *)aligned_alloc(CACHE_LINE, max(bytes, (size_t)CACHE_LINE));
+    initAccounts(slab, 0, N);
+  }
 
   print_account();
 
@@ -86,20 +469,88 @@ Bank::Bank(int N) {
  * are destroyed, and the allocated memory for accounts is freed. Additionally,
  * the bank-wide mutex is destroyed.
  *
+ * The log sink is deleted first, so every pending line is printed before
+ * the final balances. Account storage goes with whichever layout the bank
+ * used: the lazily allocated pages (with BANK_LAZY), the slab, or the
+ * structure-of-arrays balance and lock arrays (with BANK_SOA). With lock
+ * stripes, the stripe mutexes are destroyed and freed instead of the
+ * per-account ones.
+ *
  * @attention
  * - This destructor is automatically called when a Bank object goes out of
  * scope or is explicitly deleted.
  */
 Bank::~Bank() {
 
+  delete sink;  // drains the pending log lines before the summary
   print_account();
+  LOCK_STATS_REPORT(cout);
 
   pthread_mutex_destroy(&bank_lock); 
-  for(int i = 0; i < num; i ++){
-    pthread_mutex_destroy(&accounts[i].lock); 
-  }  
+  if (pages != NULL) {
+    for (int p = 0; p < num_pages; p++) {
+      char *page = pages[p].load();
+      if (page == NULL) continue;
+      for (int k = 0; k < ACCOUNT_PAGE && stripe_lock == NULL; k++) {
+        pthread_mutex_destroy(&((Account *)(page + (size_t)k * stride))->lock);
+      }
+      free(page);
+    }
+  } else if (stripe_lock == NULL) {
+    for(int i = 0; i < num; i ++){
+      pthread_mutex_destroy(lockOf(i)); 
+    }  
+  }
+  for (int i = 0; i < stripes; i++) pthread_mutex_destroy(&stripe_lock[i]);
+
+  free(slab);
+  delete[] pages;
+  delete[] stripe_lock;
+  delete[] soa_balance;
+  delete[] soa_lock;
+  delete[] counters;
+}
+
+/**
+ * @brief Initializes `n` zero-balance accounts at `stride` bytes apart from
+ * `base`, numbered from `first`. Their own mutexes are only set up when no
+ * lock stripes replace them.
+ */
+void Bank::initAccounts(char *base, int first, int n) {
+  for (int k = 0; k < n; k++) {
+    Account *a = (Account *)(base + (size_t)k * stride);
+    a->accountID = first + k;
+    a->balance.store(0, std::memory_order_relaxed);
+    if (stripe_lock == NULL) pthread_mutex_init(&a->lock, NULL);
+  }
+}
+
+/**
+ * @brief Allocates and publishes BANK_LAZY page `page` on first touch.
+ *
+ * Threads that race to touch the same page each build one; the first to
+ * publish it with a CAS wins and the others throw theirs away. The
+ * acquire/release pair makes the winner's initialization visible to every
+ * later reader of `pages[page]`.
+ *
+ * @return The published page.
+ */
+char *Bank::touchPage(int page) {
+  size_t bytes = (ACCOUNT_PAGE * stride + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+  char *fresh = (char *)aligned_alloc(CACHE_LINE, bytes);
+  initAccounts(fresh, page << ACCOUNT_PAGE_SHIFT, ACCOUNT_PAGE);
 
-  delete[] accounts; 
+  char *expected = NULL;
+  if (pages[page].compare_exchange_strong(expected, fresh,
+                                          std::memory_order_acq_rel,
+                                          std::memory_order_acquire)) {
+    return fresh;
+  }
+  for (int k = 0; k < ACCOUNT_PAGE && stripe_lock == NULL; k++) {
+    pthread_mutex_destroy(&((Account *)(fresh + (size_t)k * stride))->lock);
+  }
+  free(fresh);
+  return expected;
 }
 
 /**
@@ -111,6 +562,9 @@ Bank::~Bank() {
  *   `[ SUCCESS ] TID: {workerID}, LID: {ledgerID}, Acc: {accountID} DEPOSIT ${amount}`
  * using the DEPOSIT_MSG() macro for consistent formatting.
  *
+ * With BANK_ATOMIC the account lock is skipped and the balance is updated
+ * with a single atomic fetch_add.
+ *
  * @param workerID The ID of the worker (thread).
  * @param ledgerID The ID of the ledger entry.
  * @param accountID The account ID to deposit.
@@ -118,10 +572,11 @@ Bank::~Bank() {
  * @return 0 on success.
  */
 int Bank::deposit(int workerID, int ledgerID, int accountID, int amount) {
-  pthread_mutex_lock(&accounts[accountID].lock);
-  accounts[accountID].balance += amount;
-  recordSucc(DEPOSIT_MSG(SUCC, workerID, ledgerID, accountID, amount));
-  pthread_mutex_unlock(&accounts[accountID].lock);
+  bool locked = !(flags & BANK_ATOMIC);
+  if (locked) lockAccount(workerID, accountID);
+  credit(accountID, amount);
+  recordTxn(true, TXN_DEPOSIT, workerID, ledgerID, accountID, 0, amount);
+  if (locked) unlockAccount(accountID);
 
   return 0;
 }
@@ -143,6 +598,9 @@ int Bank::deposit(int workerID, int ledgerID, int accountID, int amount) {
  * - The function ensures that the account has a large enough balance for a
  * successful withdrawal.
  *
+ * - With BANK_ATOMIC no lock is taken: the balance is checked and reduced
+ * in one compare-and-swap loop, so it can never go negative.
+ *
  * @param workerID The ID of the worker (thread).
  * @param ledgerID The ID of the ledger entry.
  * @param accountID The account ID to withdraw from.
@@ -150,18 +608,17 @@ int Bank::deposit(int workerID, int ledgerID, int accountID, int amount) {
  * @return 0 on success, -1 on failure.
  */
 int Bank::withdraw(int workerID, int ledgerID, int accountID, int amount) {
-  pthread_mutex_lock(&accounts[accountID].lock);
-  int current_value =  accounts[accountID].balance;
+  bool locked = !(flags & BANK_ATOMIC);
+  if (locked) lockAccount(workerID, accountID);
   
-  if(current_value >= amount){
-    accounts[accountID].balance = current_value - amount; 
-    recordSucc(WITHDRAW_MSG(SUCC, workerID, ledgerID, accountID, amount));
-    pthread_mutex_unlock(&accounts[accountID].lock);
+  if(debit(accountID, amount)){
+    recordTxn(true, TXN_WITHDRAW, workerID, ledgerID, accountID, 0, amount);
+    if (locked) unlockAccount(accountID);
     return 0;
   }
   else{
-    recordFail(WITHDRAW_MSG(ERR, workerID, ledgerID, accountID, amount));
-    pthread_mutex_unlock(&accounts[accountID].lock);
+    recordTxn(false, TXN_WITHDRAW, workerID, ledgerID, accountID, 0, amount);
+    if (locked) unlockAccount(accountID);
     return -1;
   }
 }
@@ -185,6 +642,9 @@ int Bank::withdraw(int workerID, int ledgerID, int accountID, int amount) {
  * - On faiure it logs: `[ ERROR ] TID: {workerID}, LID: {ledgerID}, Acc:
  *      {accountID} TRANSFER ${amount} TO Acc: {destID}`
  * - Transfer from srcID = n to destID = n is a failure
+ * - With BANK_ATOMIC the two account locks still order transfers against
+ *     each other, but deposits and withdrawals do not take them, so the
+ *     source is debited with the same CAS loop withdraw() uses.
  *
  * @param workerID The ID of the worker (thread).
  * @param ledgerID The ID of the ledger entry.
@@ -196,29 +656,107 @@ int Bank::withdraw(int workerID, int ledgerID, int accountID, int amount) {
 int Bank::transfer(int workerID, int ledgerID, int srcID, int destID, unsigned int amount) {
   
   if(srcID == destID){
-    recordFail(TRANSFER_MSG(ERR, workerID, ledgerID, srcID, destID, amount));
+    recordTxn(false, TXN_TRANSFER, workerID, ledgerID, srcID, destID, amount);
     return -1;
   }
   
-  int first = min(srcID, destID);
-  int second = max(srcID, destID);
+  // lock in lock index order; with striped locks both may share one
+  int first = lockIndex(srcID) <= lockIndex(destID) ? srcID : destID;
+  int second = first == srcID ? destID : srcID;
+  bool shared = lockIndex(first) == lockIndex(second);
 
-  pthread_mutex_lock(&accounts[first].lock);
-  pthread_mutex_lock(&accounts[second].lock);
+  lockAccount(workerID, first);
+  if (!shared) lockAccount(workerID, second);
 
-  if(accounts[srcID].balance >= amount){
-    accounts[srcID].balance -= amount;
-    accounts[destID].balance += amount; 
-    recordSucc(TRANSFER_MSG(SUCC, workerID, ledgerID, srcID, destID, amount));
+  if(debit(srcID, amount)){
+    credit(destID, amount); 
+    recordTxn(true, TXN_TRANSFER, workerID, ledgerID, srcID, destID, amount);
 
-    pthread_mutex_unlock(&accounts[second].lock);
-    pthread_mutex_unlock(&accounts[first].lock);
+    if (!shared) unlockAccount(second);
+    unlockAccount(first);
     return 0;
   } else{
-    recordFail(TRANSFER_MSG(ERR, workerID, ledgerID, srcID, destID, amount));
-    pthread_mutex_unlock(&accounts[second].lock);
-    pthread_mutex_unlock(&accounts[first].lock);
+    recordTxn(false, TXN_TRANSFER, workerID, ledgerID, srcID, destID, amount);
+    if (!shared) unlockAccount(second);
+    unlockAccount(first);
     return -1;
   }
  
-}
\ No newline at end of file
+}
+
+/*
+ * Owner-only variants.
+ *
+ * The functions below apply the same checks and log the same lines as
+ * deposit(), withdraw() and transfer(), but take no account locks. They are
+ * for execution modes that already guarantee a single thread touches the
+ * accounts involved (e.g. account-partitioned shards).
+ */
+
+/**
+ * @brief deposit() without the account lock.
+ */
+int Bank::depositLocal(int workerID, int ledgerID, int accountID, int amount,
+                       bool counted) {
+  credit(accountID, amount);
+  recordTxn(true, TXN_DEPOSIT, workerID, ledgerID, accountID, 0, amount,
+            counted);
+  return 0;
+}
+
+/**
+ * @brief withdraw() without the account lock.
+ */
+int Bank::withdrawLocal(int workerID, int ledgerID, int accountID,
+                        int amount, bool counted) {
+  if (debit(accountID, amount)) {
+    recordTxn(true, TXN_WITHDRAW, workerID, ledgerID, accountID, 0, amount,
+              counted);
+    return 0;
+  }
+  recordTxn(false, TXN_WITHDRAW, workerID, ledgerID, accountID, 0, amount,
+            counted);
+  return -1;
+}
+
+/**
+ * @brief transfer() without the account locks; the caller owns both
+ * accounts.
+ */
+int Bank::transferLocal(int workerID, int ledgerID, int srcID, int destID,
+                        unsigned int amount, bool counted) {
+  if (transferOut(workerID, ledgerID, srcID, destID, amount, counted) < 0) {
+    return -1;
+  }
+  transferIn(destID, amount);
+  return 0;
+}
+
+/**
+ * @brief First half of a transfer whose destination is owned by another
+ * thread: checks and debits the source and logs the transfer's outcome.
+ *
+ * On success the owner of `destID` must later call transferIn() with the
+ * same amount; until then the money is in flight and not in any balance.
+ *
+ * @return 0 if the source was debited, -1 on failure (nothing changes).
+ */
+int Bank::transferOut(int workerID, int ledgerID, int srcID, int destID,
+                      unsigned int amount, bool counted) {
+  if (srcID != destID && debit(srcID, amount)) {
+    recordTxn(true, TXN_TRANSFER, workerID, ledgerID, srcID, destID, amount,
+              counted);
+    return 0;
+  }
+  recordTxn(false, TXN_TRANSFER, workerID, ledgerID, srcID, destID, amount,
+            counted);
+  return -1;
+}
+
+/**
+ * @brief Second half of a successful transferOut(): credits the
+ * destination. Not logged or counted; transferOut() already did both.
+ */
+void Bank::transferIn(int destID, unsigned int amount) {
+  credit(destID, amount);
+}
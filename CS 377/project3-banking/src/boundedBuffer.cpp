@@ -1,4 +1,23 @@
 #include <boundedBuffer.h>
+#include <lockStats.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// How many times a lock-free producer/consumer retries before it parks on
+// the futex. Kept small: on an oversubscribed machine spinning only burns
+// the quantum the other side needs to make progress.
+#define BB_SPIN_LIMIT 64
+
+static inline void futex_wait(std::atomic<uint32_t> *addr, uint32_t val) {
+  syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static inline void futex_wake(std::atomic<uint32_t> *addr, int n) {
+  syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
 
 /**
  * DO NOT DELETE
@@ -15,6 +34,7 @@ template class BoundedBuffer<int>;
  *
  * @tparam T The type of elements stored in the buffer.
  * @param N The maximum number of elements that the buffer can hold.
+ * @param mode BB_MUTEX (default) or BB_LOCKFREE.
  *
  * @details
  * - Allocates memory for the buffer
@@ -24,6 +44,9 @@ template class BoundedBuffer<int>;
  *   - `buffer_first` and `buffer_last`: Both initialized to 0, used as indices to manage the
  *     circular buffer logic.
  * - Sets up thread synchronization
+ * - In BB_LOCKFREE mode, allocates N ring slots instead, each stamped with
+ *   its index as the initial sequence number. The sequence scheme cannot
+ *   tell "full" from "free" with a single slot, so N = 1 is rounded up to 2.
  *
  * @note
  * - Ensure that the corresponding destructor properly frees the allocated memory and destroys
@@ -35,14 +58,30 @@ template class BoundedBuffer<int>;
  * @endcode
  */
 template <typename T>
-BoundedBuffer<T>::BoundedBuffer(int N) {
+BoundedBuffer<T>::BoundedBuffer(int N, int mode) : mode(mode) {
   // TODO: constructor to initiliaze all the varibales declared in
   buffer_size = N;
   buffer_cnt = 0;
   buffer_first = 0; 
   buffer_last = 0; 
 
-  buffer = new T[N];
+  buffer = NULL;
+  slots = NULL;
+  if (mode == BB_LOCKFREE) {
+    buffer_size = N = max(N, 2);
+    slots = new Slot[N];
+    for (int i = 0; i < N; i++) {
+      slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+  } else {
+    buffer = new T[N];
+  }
+  enqueue_pos.store(0, std::memory_order_relaxed);
+  dequeue_pos.store(0, std::memory_order_relaxed);
+  not_full_epoch.store(0, std::memory_order_relaxed);
+  not_full_waiters.store(0, std::memory_order_relaxed);
+  not_empty_epoch.store(0, std::memory_order_relaxed);
+  not_empty_waiters.store(0, std::memory_order_relaxed);
 
   pthread_mutex_init(&buffer_lock, NULL);
   pthread_cond_init(&buffer_not_full, NULL); 
@@ -63,6 +102,7 @@ template <typename T>
 BoundedBuffer<T>::~BoundedBuffer() {
   // TODO: destructor to clean up anything necessary
   delete[] buffer;
+  delete[] slots;
   pthread_mutex_destroy(&buffer_lock);
   pthread_cond_destroy(&buffer_not_full);
   pthread_cond_destroy(&buffer_not_empty);
@@ -80,6 +120,8 @@ BoundedBuffer<T>::~BoundedBuffer() {
  * @param data The element to be appended to the buffer.
  *
  * * @note This function will block if the buffer is full until an element is removed by another thread.
+ * In BB_LOCKFREE mode it only sleeps (on a futex) once the ring has stayed
+ * full for a short spin.
  *
  * Example usage:
  * @code
@@ -90,10 +132,22 @@ BoundedBuffer<T>::~BoundedBuffer() {
 template <typename T>
 void BoundedBuffer<T>::append(T data) {
   // TODO: append a data item to the circular buffer
-  pthread_mutex_lock(&buffer_lock);
+  if (mode == BB_LOCKFREE) {
+    for (int spins = 0; !tryAppend(data); spins++) {
+      if (spins < BB_SPIN_LIMIT) {
+        sched_yield();
+      } else {
+        park(not_full_epoch, not_full_waiters, true);
+      }
+    }
+    unpark(not_empty_epoch, not_empty_waiters);
+    return;
+  }
+
+  STAT_LOCK(&buffer_lock, LOCK_CLASS_BUFFER, -1);
 
   while(buffer_cnt == buffer_size){
-    pthread_cond_wait(&buffer_not_full, &buffer_lock);
+    STAT_COND_WAIT(&buffer_not_full, &buffer_lock, LOCK_CLASS_BUFFER, -1);
   }
 
   buffer[buffer_last] = data;
@@ -101,7 +155,7 @@ void BoundedBuffer<T>::append(T data) {
   buffer_cnt++;
 
   pthread_cond_signal(&buffer_not_empty); 
-  pthread_mutex_unlock(&buffer_lock);
+  STAT_UNLOCK(&buffer_lock, LOCK_CLASS_BUFFER, -1);
 }
 
 /**
@@ -116,21 +170,36 @@ void BoundedBuffer<T>::append(T data) {
 
  *
  * @note This function will block if the buffer is empty until an element is appended by another thread.
+ * In BB_LOCKFREE mode it only sleeps (on a futex) once the ring has stayed
+ * empty for a short spin.
  */
 template <typename T>
 T BoundedBuffer<T>::remove() {
   // TODO: remove and return a data item from the circular buffer
-  pthread_mutex_lock(&buffer_lock);
+  if (mode == BB_LOCKFREE) {
+    T data;
+    for (int spins = 0; !tryRemove(&data); spins++) {
+      if (spins < BB_SPIN_LIMIT) {
+        sched_yield();
+      } else {
+        park(not_empty_epoch, not_empty_waiters, false);
+      }
+    }
+    unpark(not_full_epoch, not_full_waiters);
+    return data;
+  }
+
+  STAT_LOCK(&buffer_lock, LOCK_CLASS_BUFFER, -1);
 
   while(buffer_cnt == 0){
-    pthread_cond_wait(&buffer_not_empty, &buffer_lock);
+    STAT_COND_WAIT(&buffer_not_empty, &buffer_lock, LOCK_CLASS_BUFFER, -1);
   }
   T data = buffer[buffer_first];
   buffer_first = (buffer_first + 1) % buffer_size; 
   buffer_cnt--;
 
   pthread_cond_signal(&buffer_not_full); 
-  pthread_mutex_unlock(&buffer_lock);
+  STAT_UNLOCK(&buffer_lock, LOCK_CLASS_BUFFER, -1);
 
   return data; 
 }
@@ -145,6 +214,242 @@ T BoundedBuffer<T>::remove() {
 template <typename T>
 bool BoundedBuffer<T>::isEmpty() {
   // TODO: check is the buffer is empty
+  if (mode == BB_LOCKFREE) {
+    return dequeue_pos.load(std::memory_order_acquire) ==
+           enqueue_pos.load(std::memory_order_acquire);
+  }
   if(buffer_cnt == 0) return true;
   else return false;  
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Appends `n` items to the buffer, in order, under as few critical
+ * sections as possible.
+ *
+ * @details
+ * In BB_MUTEX mode the lock is taken once and as many items as fit are
+ * copied in; only if the span is larger than the free space does the
+ * producer wake the consumers and wait for room. Waiters are woken once per
+ * copied chunk rather than once per item. In BB_LOCKFREE mode each item
+ * still claims its own slot, but parked consumers are woken once for the
+ * whole span (or before this producer parks itself, so a full ring can
+ * always drain).
+ *
+ * @param data The items to append.
+ * @param n The number of items in `data`.
+ *
+ * @note Blocks while the buffer is full, like append().
+ */
+template <typename T>
+void BoundedBuffer<T>::append_n(const T *data, int n) {
+  if (n <= 0) return;
+
+  if (mode == BB_LOCKFREE) {
+    int pending = 0;
+    for (int i = 0; i < n; i++) {
+      for (int spins = 0; !tryAppend(data[i]); spins++) {
+        if (pending > 0) {
+          unpark(not_empty_epoch, not_empty_waiters, pending);
+          pending = 0;
+        }
+        if (spins < BB_SPIN_LIMIT) {
+          sched_yield();
+        } else {
+          park(not_full_epoch, not_full_waiters, true);
+        }
+      }
+      pending++;
+    }
+    unpark(not_empty_epoch, not_empty_waiters, pending);
+    return;
+  }
+
+  STAT_LOCK(&buffer_lock, LOCK_CLASS_BUFFER, -1);
+  int done = 0;
+  while (done < n) {
+    while (buffer_cnt == buffer_size) {
+      STAT_COND_WAIT(&buffer_not_full, &buffer_lock, LOCK_CLASS_BUFFER, -1);
+    }
+
+    int k = min(n - done, buffer_size - buffer_cnt);
+    for (int i = 0; i < k; i++) {
+      buffer[buffer_last] = data[done + i];
+      buffer_last = (buffer_last + 1) % buffer_size;
+    }
+    buffer_cnt += k;
+    done += k;
+
+    if (k == 1) {
+      pthread_cond_signal(&buffer_not_empty);
+    } else {
+      pthread_cond_broadcast(&buffer_not_empty);
+    }
+  }
+  STAT_UNLOCK(&buffer_lock, LOCK_CLASS_BUFFER, -1);
+}
+
+/**
+ * @brief Removes between 1 and `max` items from the buffer.
+ *
+ * @details
+ * Blocks until at least one item is available, then takes everything that
+ * is there (up to `max`) in one critical section and wakes producers once.
+ *
+ * @param data Output array with room for `max` items, filled in FIFO order.
+ * @param max The maximum number of items to take.
+ * @return The number of items stored in `data`.
+ */
+template <typename T>
+int BoundedBuffer<T>::remove_up_to(T *data, int max) {
+  if (max <= 0) return 0;
+
+  if (mode == BB_LOCKFREE) {
+    for (int spins = 0; !tryRemove(&data[0]); spins++) {
+      if (spins < BB_SPIN_LIMIT) {
+        sched_yield();
+      } else {
+        park(not_empty_epoch, not_empty_waiters, false);
+      }
+    }
+    int k = 1;
+    while (k < max && tryRemove(&data[k])) k++;
+    unpark(not_full_epoch, not_full_waiters, k);
+    return k;
+  }
+
+  STAT_LOCK(&buffer_lock, LOCK_CLASS_BUFFER, -1);
+  while (buffer_cnt == 0) {
+    STAT_COND_WAIT(&buffer_not_empty, &buffer_lock, LOCK_CLASS_BUFFER, -1);
+  }
+
+  int k = min(max, buffer_cnt);
+  for (int i = 0; i < k; i++) {
+    data[i] = buffer[buffer_first];
+    buffer_first = (buffer_first + 1) % buffer_size;
+  }
+  buffer_cnt -= k;
+
+  if (k == 1) {
+    pthread_cond_signal(&buffer_not_full);
+  } else {
+    pthread_cond_broadcast(&buffer_not_full);
+  }
+  STAT_UNLOCK(&buffer_lock, LOCK_CLASS_BUFFER, -1);
+
+  return k;
+}
+
+/**
+ * @brief Attempts to claim a ring slot and store `data` without blocking.
+ *
+ * @details
+ * Slot i of the ring is free for the producer at position `pos` exactly when
+ * its sequence number equals `pos`. The producer claims the position by
+ * advancing `enqueue_pos` with a CAS, writes the item, and publishes it by
+ * bumping the slot's sequence to `pos + 1`, which is what the consumer at
+ * that position waits for.
+ *
+ * @return true if the item was stored, false if the ring is full.
+ */
+template <typename T>
+bool BoundedBuffer<T>::tryAppend(T data) {
+  size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+  Slot *slot;
+  for (;;) {
+    slot = &slots[pos % buffer_size];
+    size_t seq = slot->seq.load(std::memory_order_acquire);
+    intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+    if (dif == 0) {
+      if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (dif < 0) {
+      return false;  // the consumer a full lap behind has not freed it yet
+    } else {
+      pos = enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+  slot->data = data;
+  slot->seq.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+/**
+ * @brief Attempts to take the oldest published item without blocking.
+ *
+ * @details
+ * Mirror image of tryAppend(): the consumer at position `pos` may read the
+ * slot once its sequence is `pos + 1`, and hands it back to the producer of
+ * the next lap by setting the sequence to `pos + buffer_size`.
+ *
+ * @return true if an item was stored in `*data`, false if the ring is empty.
+ */
+template <typename T>
+bool BoundedBuffer<T>::tryRemove(T *data) {
+  size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+  Slot *slot;
+  for (;;) {
+    slot = &slots[pos % buffer_size];
+    size_t seq = slot->seq.load(std::memory_order_acquire);
+    intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+    if (dif == 0) {
+      if (dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (dif < 0) {
+      return false;
+    } else {
+      pos = dequeue_pos.load(std::memory_order_relaxed);
+    }
+  }
+  *data = slot->data;
+  slot->seq.store(pos + buffer_size, std::memory_order_release);
+  return true;
+}
+
+/**
+ * @brief Sleeps until the other side of the ring signals progress.
+ *
+ * @details
+ * The caller registers in `waiters` before re-checking the ring, and the
+ * other side bumps `epoch` after publishing and then checks `waiters`. With
+ * a full fence on both sides at least one of them sees the other, so a
+ * wakeup cannot be lost between the re-check and FUTEX_WAIT; if `epoch`
+ * already moved, the futex call returns immediately.
+ *
+ * @param wantSpace true when a producer waits for a free slot, false when a
+ *        consumer waits for an item.
+ */
+template <typename T>
+void BoundedBuffer<T>::park(std::atomic<uint32_t> &epoch,
+                            std::atomic<int> &waiters, bool wantSpace) {
+  uint32_t e = epoch.load(std::memory_order_acquire);
+  waiters.fetch_add(1, std::memory_order_seq_cst);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  size_t head = dequeue_pos.load(std::memory_order_acquire);
+  size_t tail = enqueue_pos.load(std::memory_order_acquire);
+  bool ready = wantSpace ? tail - head < (size_t)buffer_size : tail != head;
+  if (!ready) {
+    futex_wait(&epoch, e);
+  }
+  waiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Wakes up to `n` threads parked on `epoch`, if there are any.
+ *
+ * The common uncontended case costs a fence and a load; the syscall is only
+ * made when someone actually went to sleep.
+ */
+template <typename T>
+void BoundedBuffer<T>::unpark(std::atomic<uint32_t> &epoch,
+                              std::atomic<int> &waiters, int n) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (n > 0 && waiters.load(std::memory_order_relaxed) > 0) {
+    epoch.fetch_add(1, std::memory_order_release);
+    futex_wake(&epoch, n);
+  }
+}
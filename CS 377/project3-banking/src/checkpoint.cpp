@@ -0,0 +1,146 @@
+#include <checkpoint.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Copies the bank's nonzero balances and outcome counts.
+ *
+ * No locks are taken: the caller must make sure nothing is applied to the
+ * bank while this runs (e.g. between two windows of run_deterministic()).
+ * The copy is O(accounts); untouched BANK_LAZY pages are skipped.
+ *
+ * @param last_ledger The last ledgerID whose effects are in the bank.
+ */
+void capture_snapshot(Bank *bank, int64_t last_ledger, Snapshot &out) {
+  out.last_ledger = last_ledger;
+  out.succ = bank->getNumSucc();
+  out.fail = bank->getNumFail();
+  out.accounts = bank->getNum();
+  out.balances.clear();
+  for (int i = 0; i < bank->getNum(); i++) {
+    if (!bank->exists(i)) {
+      i |= ACCOUNT_PAGE - 1;
+      continue;
+    }
+    long balance = bank->balanceOf(i).load(std::memory_order_relaxed);
+    if (balance != 0) out.balances.push_back({i, balance});
+  }
+}
+
+/**
+ * @brief Writes a snapshot so that `filename` always holds a complete one.
+ *
+ * The data goes to `filename`.tmp, is fsync()ed, and is then renamed over
+ * `filename`, and the directory is fsync()ed so the rename itself is on
+ * disk; a crash at any point leaves either the old or the new snapshot
+ * behind, never a torn one.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int write_snapshot(const char *filename, const Snapshot &snap) {
+  SnapshotHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, SNAPSHOT_MAGIC, 4);
+  h.version = SNAPSHOT_VERSION;
+  h.last_ledger = snap.last_ledger;
+  h.succ = snap.succ;
+  h.fail = snap.fail;
+  h.accounts = snap.accounts;
+  h.count = snap.balances.size();
+
+  vector<char> buf(sizeof(h) + h.count * 16);
+  memcpy(buf.data(), &h, sizeof(h));
+  char *p = buf.data() + sizeof(h);
+  for (const pair<int, long> &b : snap.balances) {
+    int32_t id = b.first;
+    int64_t balance = b.second;
+    memset(p, 0, 16);
+    memcpy(p, &id, 4);
+    memcpy(p + 8, &balance, 8);
+    p += 16;
+  }
+
+  string tmp = string(filename) + ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return -1;
+  size_t done = 0;
+  while (done < buf.size()) {
+    ssize_t n = write(fd, buf.data() + done, buf.size() - done);
+    if (n <= 0) break;
+    done += n;
+  }
+  bool ok = done == buf.size() && fsync(fd) == 0;
+  if (close(fd) != 0 || !ok || rename(tmp.c_str(), filename) != 0) {
+    unlink(tmp.c_str());
+    return -1;
+  }
+
+  string name = filename;
+  size_t slash = name.rfind('/');
+  string dir = slash == string::npos ? "." : name.substr(0, slash + 1);
+  int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (dir_fd < 0) return -1;
+  ok = fsync(dir_fd) == 0;
+  close(dir_fd);
+  return ok ? 0 : -1;
+}
+
+/**
+ * @brief Reads a snapshot written by write_snapshot().
+ *
+ * @return 0 on success, -1 if the file is missing, short or not a snapshot.
+ */
+int read_snapshot(const char *filename, Snapshot &out) {
+  FILE *f = fopen(filename, "rb");
+  if (f == NULL) return -1;
+
+  // the header's count is checked against the file before it sizes
+  // anything, so a corrupt one cannot ask for more memory than the file has
+  SnapshotHeader h;
+  struct stat st;
+  bool ok = fstat(fileno(f), &st) == 0 && fread(&h, sizeof(h), 1, f) == 1 &&
+            memcmp(h.magic, SNAPSHOT_MAGIC, 4) == 0 &&
+            h.version == SNAPSHOT_VERSION && h.accounts >= 0 &&
+            h.count <= ((uint64_t)st.st_size - sizeof(h)) / 16;
+  if (ok) {
+    out.last_ledger = h.last_ledger;
+    out.succ = h.succ;
+    out.fail = h.fail;
+    out.accounts = h.accounts;
+    out.balances.clear();
+    out.balances.reserve(h.count);
+    char rec[16];
+    for (uint64_t i = 0; ok && i < h.count; i++) {
+      ok = fread(rec, sizeof(rec), 1, f) == 1;
+      int32_t id;
+      int64_t balance;
+      memcpy(&id, rec, 4);
+      memcpy(&balance, rec + 8, 8);
+      ok = ok && id >= 0 && id < h.accounts;
+      out.balances.push_back({id, balance});
+    }
+  }
+  fclose(f);
+  return ok ? 0 : -1;
+}
+
+/**
+ * @brief Loads a snapshot into a freshly constructed bank: balances and
+ * outcome counts, as if the ledger up to `snap.last_ledger` had just been
+ * applied to it.
+ *
+ * @return 0 on success, -1 if a snapshot account is outside the bank.
+ */
+int apply_snapshot(Bank *bank, const Snapshot &snap) {
+  for (const pair<int, long> &b : snap.balances) {
+    if (b.first >= bank->getNum()) return -1;
+  }
+  for (const pair<int, long> &b : snap.balances) {
+    bank->balanceOf(b.first).store(b.second, std::memory_order_relaxed);
+  }
+  bank->countBatch(0, snap.succ, snap.fail);
+  return 0;
+}
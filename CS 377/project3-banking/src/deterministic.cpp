@@ -0,0 +1,218 @@
+#include <checkpoint.h>
+#include <ledger.h>
+
+// One node of the conflict DAG, per ledger entry. An entry depends on the
+// previous entry in its window that touched each of its accounts, so it has
+// at most two predecessors and at most two successors.
+struct DetNode {
+  std::atomic<int> pending;  // predecessors not yet applied
+  int succ[2];               // arena indices of the next touchers
+  int num_succ;
+};
+
+static DetNode *nodes;
+static BoundedBuffer<Ledger *> *ready;  // entries whose predecessors are done
+static std::atomic<int> window_left;    // entries of the running window
+static bool window_done;
+static pthread_mutex_t window_lock;
+static pthread_cond_t window_cond;
+
+static inline void add_edge(int from, int to) {
+  DetNode &n = nodes[from];
+  if (n.num_succ > 0 && n.succ[n.num_succ - 1] == to) return;  // same pair
+  n.succ[n.num_succ++] = to;
+  nodes[to].pending.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Builds the conflict DAG for arena entries [begin, end).
+ *
+ * Each entry's write set is `acc`, plus `other` for a transfer. The entry
+ * gets an edge from the last earlier entry in the window with an
+ * overlapping write set, which orders all operations on an account exactly
+ * as in the ledger. Entries with no predecessor are returned in `roots`.
+ *
+ * @param last Scratch map from account to its last toucher, empty on entry
+ * and on return.
+ */
+static void build_window(int begin, int end, unordered_map<int, int> &last,
+                         vector<int> &roots) {
+  roots.clear();
+  for (int i = begin; i < end; i++) {
+    nodes[i].pending.store(0, std::memory_order_relaxed);
+    nodes[i].num_succ = 0;
+  }
+  for (int i = begin; i < end; i++) {
+    Ledger &e = ledger_arena[i];
+    auto prev = last.emplace(e.acc, i);
+    if (!prev.second) {
+      add_edge(prev.first->second, i);
+      prev.first->second = i;
+    }
+    if (e.mode == T && e.other != e.acc) {
+      prev = last.emplace(e.other, i);
+      if (!prev.second) {
+        add_edge(prev.first->second, i);
+        prev.first->second = i;
+      }
+    }
+  }
+  last.clear();
+  for (int i = begin; i < end; i++) {
+    if (nodes[i].pending.load(std::memory_order_relaxed) == 0) {
+      roots.push_back(i);
+    }
+  }
+}
+
+/**
+ * @brief Worker thread for EXEC_DETERMINISTIC: applies ready entries and
+ * releases their successors until it removes the NULL sentinel.
+ *
+ * @details
+ * The DAG guarantees no two entries sharing an account are in flight at
+ * once, so entries are applied with the lock-free *Local bank operations.
+ * The acq_rel decrement on a successor's `pending` (and the hand-off
+ * through `ready`) orders its balance reads after our writes.
+ *
+ * @param workerID A pointer to the worker's index.
+ * @return NULL.
+ */
+static void *det_worker(void *workerID) {
+  int id = *((int *)workerID);
+  Ledger *entry;
+  while ((entry = ready->remove()) != NULL) {
+    if (entry->mode == D) {
+      bank->depositLocal(id, entry->ledgerID, entry->acc, entry->amount);
+    } else if (entry->mode == W) {
+      bank->withdrawLocal(id, entry->ledgerID, entry->acc, entry->amount);
+    } else if (entry->mode == T) {
+      bank->transferLocal(id, entry->ledgerID, entry->acc, entry->other,
+                          entry->amount);
+    }
+
+    DetNode &n = nodes[entry - ledger_arena.data()];
+    for (int k = 0; k < n.num_succ; k++) {
+      int s = n.succ[k];
+      if (nodes[s].pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        ready->append(&ledger_arena[s]);
+      }
+    }
+
+    if (window_left.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      pthread_mutex_lock(&window_lock);
+      window_done = true;
+      pthread_cond_signal(&window_cond);
+      pthread_mutex_unlock(&window_lock);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Runs the loaded ledger in deterministic (EXEC_DETERMINISTIC) mode.
+ *
+ * @details
+ * The ledger is cut into windows of DET_WINDOW entries. The calling thread
+ * schedules: it builds a window's conflict DAG (see build_window()), seeds
+ * the roots into a ready queue, and builds the next window's DAG while c
+ * workers execute the current one. Windows are separated by a barrier, so
+ * no edges cross them.
+ *
+ * Every account sees its operations in ledgerID order, which makes final
+ * balances and success/fail counts identical to a serial run. Only the
+ * order of the log lines (and the TIDs in them) varies.
+ *
+ * The barriers double as checkpoint epochs. With `opts.checkpoint_file`
+ * set, the bank is copied at the first barrier after every
+ * `opts.checkpoint_every` entries, and at the last one; the workers only
+ * wait for that O(accounts) copy, and the file is written while they run
+ * the next window.
+ *
+ * With a write-ahead log at WAL_SYNC, the barrier is also where the log is
+ * synced: workers never wait on it, and each window costs one fsync rather
+ * than one per entry.
+ *
+ * @attention
+ * Scheduling is done by one thread, so `p` is unused. The ready queue holds
+ * at most one window and is sized for it, so `size` is unused as well.
+ *
+ * @param p Unused.
+ * @param c The number of worker threads.
+ * @param size Unused.
+ */
+void run_deterministic(int p, int c, int size) {
+  (void)p;
+  (void)size;
+  nodes = new DetNode[max_items > 0 ? max_items : 1];
+  ready = new BoundedBuffer<Ledger *>(DET_WINDOW + c, opts.bb_mode);
+  pthread_mutex_init(&window_lock, NULL);
+  pthread_cond_init(&window_cond, NULL);
+
+  unordered_map<int, int> last;
+  last.reserve(2 * DET_WINDOW);
+
+  pthread_t *workers = new pthread_t[c];
+  int *workerIDs = new int[c];
+  for (int i = 0; i < c; i++) {
+    workerIDs[i] = i;
+    int check = pthread_create(&workers[i], NULL, det_worker, &workerIDs[i]);
+    assert(check == 0);
+  }
+
+  vector<int> roots, next_roots;
+  Snapshot snap;
+  bool snap_pending = false;
+  long since_checkpoint = 0;
+  int begin = 0;
+  int end = min(DET_WINDOW, max_items);
+  build_window(begin, end, last, roots);
+  while (begin < end) {
+    window_done = false;
+    window_left.store(end - begin, std::memory_order_relaxed);
+    for (int r : roots) ready->append(&ledger_arena[r]);
+
+    // overlap: the last barrier's snapshot is written and the next window's
+    // DAG is built while this one runs
+    if (snap_pending) {
+      if (write_snapshot(opts.checkpoint_file, snap) < 0) {
+        cerr << "ERR: CHECKPOINT NOT WRITTEN" << endl;
+      }
+      snap_pending = false;
+    }
+    int next_end = min(end + DET_WINDOW, max_items);
+    build_window(end, next_end, last, next_roots);
+
+    pthread_mutex_lock(&window_lock);
+    while (!window_done) pthread_cond_wait(&window_cond, &window_lock);
+    pthread_mutex_unlock(&window_lock);
+
+    // barrier: the bank holds exactly the serial state through `end`, and
+    // with WAL_SYNC the window's records become durable in one wait
+    bank->syncWalAll();
+    since_checkpoint += end - begin;
+    if (opts.checkpoint_file != NULL &&
+        (since_checkpoint >= opts.checkpoint_every || next_end == end)) {
+      capture_snapshot(bank, ledger_arena[end - 1].ledgerID, snap);
+      snap_pending = true;
+      since_checkpoint = 0;
+    }
+
+    begin = end;
+    end = next_end;
+    roots.swap(next_roots);
+  }
+  if (snap_pending && write_snapshot(opts.checkpoint_file, snap) < 0) {
+    cerr << "ERR: CHECKPOINT NOT WRITTEN" << endl;
+  }
+
+  for (int i = 0; i < c; i++) ready->append(NULL);
+  for (int i = 0; i < c; i++) pthread_join(workers[i], NULL);
+
+  pthread_mutex_destroy(&window_lock);
+  pthread_cond_destroy(&window_cond);
+  delete ready;
+  delete[] nodes;
+  delete[] workers;
+  delete[] workerIDs;
+}
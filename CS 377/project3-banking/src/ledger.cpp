@@ -1,15 +1,38 @@
+#include <checkpoint.h>
 #include <ledger.h>
+#include <ledgerFile.h>
+#include <unistd.h>
+#include <algorithm>
 
 using namespace std;
 
 
 pthread_mutex_t ledger_lock;
 
-list<struct Ledger *> ledger;
+vector<struct Ledger> ledger_arena;  // every entry, contiguous, in file order
+LedgerRange *ranges;  // one per producer, over ledger_arena
+int num_ranges;
 BoundedBuffer<struct Ledger*> *bb;
 Bank *bank;
 int max_items; // total number of items in the ledger
 int con_items; // total number of items consumed
+struct Options opts = {BB_MUTEX, 32, 0, 0, EXEC_SHARED, 0, 10, 0,
+                       NULL, 100000, NULL, NULL, WAL_GROUP, 1000, 0};
+static LedgerFileHeader loaded_header;  // magic[0] == 0 unless binary
+uint64_t *trace_enqueue = NULL;
+uint64_t *trace_done = NULL;
+
+// Entries that are already in the bank when the run starts: ledgerIDs up
+// to the restored snapshot's last one, and those replayed from the WAL.
+// The loaded ledger drops them up front; a stream drops them as they go by.
+static int64_t resume_after = -1;
+static vector<char> wal_logged;
+
+// EXEC_SHARED over a LedgerStream: the entries in flight cycle through a
+// fixed pool, so memory does not grow with the ledger.
+static LedgerStream *ledger_stream;
+static BoundedBuffer<struct Ledger *> *free_slots;
+static std::atomic<long> stream_rejected;
 
 /**
  * @brief Initializes a banking system with a specified number of
@@ -24,10 +47,29 @@ int con_items; // total number of items consumed
  * the bank's accounts.
  *
  * @attention
- * - Initialize the bank with 10 accounts.
+ * - Initialize the bank with `opts.accounts` accounts (10 by default). With
+ * `opts.accounts` == 0 the ledger decides: one past the largest account ID
+ * it mentions. Either way, a ledger that names an account outside the bank
+ * is rejected before any thread starts.
  * - If `load_ledger()` fails, exit and free allocated memory.
  * - Be careful how you pass the thread ID to ensure the value does not change.
+ * - Producers do not share a queue: producer i owns the i-th slice of
+ * `ledger_arena` as a LedgerRange and steals from the others when it runs
+ * dry (see producer()).
  * - Don't forget to join all created threads.
+ * - The bounded buffer backend is taken from `opts.bb_mode`, the bank
+ * flags from `opts.bank_flags`.
+ * - `con_items` is reset so the bank can be run more than once per process.
+ * - `opts.exec_mode` picks how the loaded ledger is executed: run_shared()
+ * (the default), run_sharded() or run_deterministic().
+ * - With `opts.restore_file`, the bank starts from that snapshot and only
+ * the entries after its last ledgerID are run.
+ * - With `opts.wal_file`, the log is replayed on top of that (see
+ * recover_wal()) and every new outcome is appended to it.
+ * - With `opts.stream`, nothing is loaded: the file (or stdin for "-") is
+ * parsed while the bank runs, see run_stream(). The bank cannot be sized
+ * from a ledger it has not read, so `opts.accounts` must be set, and
+ * entries naming accounts outside it are skipped and reported at the end.
  *
  * @param p The number of producer threads.
  * @param c The number of consumer threads.
@@ -38,30 +80,126 @@ int con_items; // total number of items consumed
  */
 void InitBank(int p, int c, int size, char *filename) {
   
-  bank = new Bank(10);
-  bb = new BoundedBuffer<Ledger*>(size);
-  pthread_t* producers = new pthread_t[p];
-  pthread_t* consumers = new pthread_t[c];
-  int* workerIDs = new int[c]; 
+  LedgerStream *stream = NULL;
+  if (opts.stream) {
+    stream = new LedgerStream(filename);
+    if (!stream->ok()) {
+      cout << "ERR: FILE NOT READ" << endl;
+      delete stream;
+      return;
+    }
+  } else if (load_ledger(filename) < 0){
+    cout << "ERR: FILE NOT READ" << endl;
+    return;
+  }  
+
+  Snapshot snap;
+  snap.accounts = 0;
+  if (opts.restore_file != NULL && read_snapshot(opts.restore_file, snap) < 0) {
+    cout << "ERR: SNAPSHOT NOT READ" << endl;
+    delete stream;
+    vector<Ledger>().swap(ledger_arena);
+    return;
+  }
+
+  int lo, hi;
+  ledger_account_range(&lo, &hi);
+  int accounts = opts.accounts > 0 ? opts.accounts : max(hi + 1, snap.accounts);
+  if (lo < 0 || hi >= accounts) {
+    cout << "ERR: ACCOUNT " << (lo < 0 ? lo : hi) << " OUT OF RANGE" << endl;
+    delete stream;
+    vector<Ledger>().swap(ledger_arena);
+    return;
+  }
+
+  bank = new Bank(accounts, opts.bank_flags, opts.stripes);
   pthread_mutex_init(&ledger_lock, NULL);
 
+  if (opts.restore_file != NULL) {
+    if (apply_snapshot(bank, snap) < 0) {
+      cout << "ERR: SNAPSHOT DOES NOT FIT THE BANK" << endl;
+      delete stream;
+      delete bank;
+      pthread_mutex_destroy(&ledger_lock);
+      vector<Ledger>().swap(ledger_arena);
+      return;
+    }
+    skip_applied(snap.last_ledger);
+    resume_after = snap.last_ledger;
+  }
+
+  WriteAheadLog *wal = NULL;
+  if (opts.wal_file != NULL) {
+    wal = recover_wal(opts.restore_file != NULL ? snap.last_ledger : -1);
+    if (wal == NULL) {
+      cout << "ERR: WAL NOT USABLE" << endl;
+      delete stream;
+      delete bank;
+      pthread_mutex_destroy(&ledger_lock);
+      vector<Ledger>().swap(ledger_arena);
+      return;
+    }
+  }
 
+  max_items = ledger_arena.size(); 
+  con_items = 0;
+
+  if (stream != NULL) {
+    run_stream(p, c, size, stream);
+  } else if (opts.exec_mode == EXEC_SHARDED) {
+    run_sharded(p, c, size);
+  } else if (opts.exec_mode == EXEC_DETERMINISTIC) {
+    run_deterministic(p, c, size);
+  } else {
+    run_shared(p, c, size);
+  }
 
-  if (load_ledger(filename) < 0){
-    cout << "ERR: FILE NOT READ" << endl;
-    delete bank;
-    delete bb;
-    delete[] producers;
-    delete[] consumers;
-    delete[] workerIDs;
-    pthread_mutex_destroy(&ledger_lock); 
-    return;
-  }  
+  if (stream_rejected > 0) {
+    cout << "ERR: " << stream_rejected << " ENTRIES OUT OF RANGE SKIPPED"
+         << endl;
+  }
 
-  max_items = ledger.size(); 
+  if (wal != NULL) bank->checkWal(wal->flush());
+  delete wal;  // last group is on disk before the final balances print
+  delete bank;
+  delete stream;
+  pthread_mutex_destroy(&ledger_lock);
+  vector<Ledger>().swap(ledger_arena);
+  vector<char>().swap(wal_logged);
+  resume_after = -1;
+  stream_rejected = 0;
+
+
+  return; 
+}
+
+/**
+ * @brief Runs the loaded ledger through p producers, one shared bounded
+ * buffer of the given size, and c consumers (the default EXEC_SHARED mode).
+ *
+ * @param p The number of producer threads.
+ * @param c The number of consumer threads.
+ * @param size The size of the bounded buffer.
+ */
+void run_shared(int p, int c, int size) {
+  bb = new BoundedBuffer<Ledger*>(size, opts.bb_mode);
+  pthread_t* producers = new pthread_t[p];
+  pthread_t* consumers = new pthread_t[c];
+  int* workerIDs = new int[c]; 
+  int* producerIDs = new int[p];
+
+  // Producer i starts out owning the i-th equal slice of the arena.
+  num_ranges = p;
+  ranges = new LedgerRange[p];
+  for(int i = 0; i < p; i ++){
+    uint32_t begin = (uint64_t)max_items * i / p;
+    uint32_t end = (uint64_t)max_items * (i + 1) / p;
+    ranges[i].span.store(pack_range(begin, end));
+  }
 
   for(int i = 0; i < p; i ++){
-    int check = pthread_create(&producers[i], NULL, producer, NULL);
+    producerIDs[i] = i;
+    int check = pthread_create(&producers[i], NULL, producer, (void*)&producerIDs[i]);
     assert(check == 0);
   }
 
@@ -79,21 +217,84 @@ void InitBank(int p, int c, int size, char *filename) {
   
 
   for(int i = 0; i < c; i++){
-    int check = pthread_join(consumers[i], NULL);
-    //assert(check == 0);
+    pthread_join(consumers[i], NULL);
   }
 
-  //cout << "running" << endl;
-
-  delete bank;
   delete bb;
   delete[] producers;
   delete[] consumers;
   delete[] workerIDs;
-  pthread_mutex_destroy(&ledger_lock);
+  delete[] producerIDs;
+  delete[] ranges;
+}
 
+/**
+ * @brief Runs a ledger that is parsed as it goes: p producers read
+ * `stream` straight into the shared bounded buffer while c consumers apply
+ * what is already there.
+ *
+ * @details
+ * Entries live in a pool of `size + (p + c) * opts.batch` slots, enough
+ * for a full buffer plus one batch in every thread's hands. A producer
+ * takes free slots before it parses into them and a consumer hands them
+ * back once applied, so when consumers fall behind producers stop reading
+ * (and a writer on the other end of a FIFO or pipe blocks). Memory is
+ * bounded by the buffer size, not the length of the ledger.
+ *
+ * The number of entries is not known up front, so the end of the stream
+ * is marked instead of counted: once every producer is done, one NULL per
+ * consumer goes into the buffer behind the last entry.
+ *
+ * @param p The number of producer threads.
+ * @param c The number of consumer threads.
+ * @param size The size of the bounded buffer.
+ * @param stream The open ledger.
+ */
+void run_stream(int p, int c, int size, LedgerStream *stream) {
+  bb = new BoundedBuffer<Ledger*>(size, opts.bb_mode);
+  int slots = size + (p + c) * opts.batch;
+  vector<Ledger> pool(slots);
+  free_slots = new BoundedBuffer<Ledger*>(slots);
+  for (int i = 0; i < slots; i++) {
+    free_slots->append(&pool[i]);
+  }
+  ledger_stream = stream;
 
-  return; 
+  pthread_t* producers = new pthread_t[p];
+  pthread_t* consumers = new pthread_t[c];
+  int* workerIDs = new int[c]; 
+  int* producerIDs = new int[p];
+
+  for(int i = 0; i < p; i ++){
+    producerIDs[i] = i;
+    int check = pthread_create(&producers[i], NULL, stream_producer, (void*)&producerIDs[i]);
+    assert(check == 0);
+  }
+
+  for(int i = 0; i < c; i++){
+    workerIDs[i] = i; 
+    int check = pthread_create(&consumers[i], NULL, stream_consumer, (void*)&workerIDs[i]);
+    assert(check == 0);
+  }
+
+  for(int i = 0; i < p; i ++){
+    int check = pthread_join(producers[i], NULL);
+    assert(check == 0);
+  }
+  for(int i = 0; i < c; i++){
+    bb->append(NULL);
+  }
+
+  for(int i = 0; i < c; i++){
+    pthread_join(consumers[i], NULL);
+  }
+
+  delete bb;
+  delete free_slots;
+  delete[] producers;
+  delete[] consumers;
+  delete[] workerIDs;
+  delete[] producerIDs;
 }
 
 /**
@@ -105,52 +306,248 @@ void InitBank(int p, int c, int size, char *filename) {
  *   - Other (int): for transfers, the other account number; otherwise not used
  *   - Amount (int): the amount to deposit, withdraw, or transfer
  *   - Mode (Enum): 0 for deposit, 1 for withdraw, 2 for transfer
- * The function then creates ledger entries and appends them to the ledger list
- * of the banking system.
+ * The function then stores the ledger entries in `ledger_arena`, in file
+ * order.
  *
  * @attention
  * - If the file cannot be opened, the function returns -1, indicating failure.
  * - The function expects a specific file format as indicated above.
  * - Each line in the file corresponds to a ledger entry.
  * - The ledgerID starts with 0.
+ * - Binary ledgers written by `ledger_convert` are detected by their magic
+ * number and decoded directly from the mapping instead of being parsed.
+ * - The file is mmapped and parsed on `opts.load_threads` threads (see
+ * read_ledger_file()) straight into the contiguous `ledger_arena`, so
+ * there is no allocation per entry.
  *
  * @param filename The name of the file containing the ledger data.
  * @return 0 on success, -1 on failure to open the file.
  */
 int load_ledger(char *filename) {
-  int ledgerID = 0;
-  int acc, other, amount, mode; 
-  FILE *fptr = fopen(filename, "r");
+  int threads = opts.load_threads;
+  if (threads <= 0) {
+    threads = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+  }
 
-  if(fptr == NULL){
+  if (read_ledger_file(filename, ledger_arena, threads, &loaded_header) < 0) {
     return -1;
   }
+  return 0; 
 
-  while(fscanf(fptr, "%d %d %d %d", &acc, &other, &amount, &mode) == 4){
-    Ledger* newLedger = new Ledger;
+}
 
-    newLedger->acc = acc;
-    newLedger->other = other; 
-    newLedger->amount = amount; 
-    newLedger->mode = mode;
-    newLedger->ledgerID = ledgerID;
+/**
+ * @brief Rebuilds the bank from `opts.wal_file` and opens it for appending.
+ *
+ * Every intact record with a ledgerID after `after` (the restored
+ * snapshot's last entry, or -1) is replayed into `bank`, and its entry is
+ * dropped from `ledger_arena` (or later from the stream), so a rerun after
+ * a crash applies each entry exactly once even though consumers finish
+ * entries out of order.
+ *
+ * @return The open log, attached to `bank`, or NULL on error.
+ */
+WriteAheadLog *recover_wal(int64_t after) {
+  vector<WalRecord> log;
+  if (read_wal(opts.wal_file, log) < 0) return NULL;
+
+  vector<char> &logged = wal_logged;
+  logged.clear();
+  for (const WalRecord &r : log) {
+    if (r.ledgerID <= after || r.ledgerID < 0) continue;
+    if (r.acc >= bank->getNum() || r.other >= bank->getNum() || r.acc < 0 ||
+        r.other < 0) {
+      return NULL;
+    }
+    bank->replay(r);
+    if ((size_t)r.ledgerID >= logged.size()) logged.resize(r.ledgerID + 1, 0);
+    logged[r.ledgerID] = 1;
+  }
+  ledger_arena.erase(
+      remove_if(ledger_arena.begin(), ledger_arena.end(),
+                [&logged](const Ledger &e) {
+                  return e.ledgerID >= 0 && (size_t)e.ledgerID < logged.size() &&
+                         logged[e.ledgerID];
+                }),
+      ledger_arena.end());
+
+  WriteAheadLog *wal =
+      new WriteAheadLog(opts.wal_file, opts.wal_level, opts.wal_interval_us);
+  if (!wal->ok()) {
+    delete wal;
+    return NULL;
+  }
+  bank->setWal(wal);
+  return wal;
+}
+
+// True if `id` is already in the bank (see resume_after and wal_logged).
+static bool already_applied(int id) {
+  if (opts.restore_file != NULL && id <= resume_after) return true;
+  return opts.wal_file != NULL && (size_t)id < wal_logged.size() &&
+         wal_logged[id];
+}
 
-    //cout << acc << endl;
-    //cout << other << endl;
-    //cout << amount << endl;
-    //cout << mode << endl;
+/**
+ * @brief Drops the entries a restored snapshot already covers (ledgerID <=
+ * `last`) from the front of `ledger_arena`.
+ */
+void skip_applied(int64_t last) {
+  auto first = partition_point(
+      ledger_arena.begin(), ledger_arena.end(),
+      [last](const Ledger &e) { return e.ledgerID <= last; });
+  ledger_arena.erase(ledger_arena.begin(), first);
+}
 
-    pthread_mutex_lock(&ledger_lock);
-    ledger.push_back(newLedger); 
-    pthread_mutex_unlock(&ledger_lock);
-    ledgerID++; 
+/**
+ * @brief The smallest and largest account IDs the loaded ledger touches.
+ *
+ * A binary ledger records them in its header; a text ledger is scanned.
+ * `other` only counts for transfers. An empty ledger gives [0, 0].
+ */
+void ledger_account_range(int *lo, int *hi) {
+  if (loaded_header.magic[0] != 0) {
+    *lo = min(loaded_header.min_acc, 0);
+    *hi = max(loaded_header.max_acc, 0);
+    return;
+  }
+  *lo = 0;
+  *hi = 0;
+  for (const Ledger &e : ledger_arena) {
+    *lo = min(*lo, e.acc);
+    *hi = max(*hi, e.acc);
+    if (e.mode == T) {
+      *lo = min(*lo, e.other);
+      *hi = max(*hi, e.other);
+    }
   }
+}
 
+/**
+ * @brief Applies one ledger entry to the bank.
+ *
+ * Dispatches on the entry's mode to deposit (D), withdraw (W) or transfer
+ * (T). Shared by every consumer flavour so they all log and count the same
+ * way.
+ *
+ * @param workerID The ID of the worker (thread) applying the entry.
+ * @param entry The ledger entry to apply.
+ */
+void process_entry(int workerID, struct Ledger *entry) {
+  if(entry->mode == D){
+    bank->deposit(workerID, entry->ledgerID, entry->acc, entry->amount);
+  }
+  
+  else if(entry->mode == T){
+    bank->transfer(workerID, entry->ledgerID, entry->acc, entry->other, entry->amount);
+  }
+  
+  else if(entry->mode == W){
+    bank->withdraw(workerID, entry->ledgerID, entry->acc, entry->amount);
+  }
+}
 
+// Union-find over account IDs, reused by one consumer across batches.
+// Only accounts merged in the current batch have an entry, so its size
+// follows the batch, not the bank.
+int GroupScratch::find(int a) {
+  auto it = parent.find(a);
+  while (it != parent.end()) {
+    a = it->second;
+    it = parent.find(a);
+  }
+  return a;
+}
 
-  fclose(fptr);
-  return 0; 
+void GroupScratch::unite(int a, int b) {
+  a = find(a);
+  b = find(b);
+  if (a != b) parent[max(a, b)] = min(a, b);
+}
+
+/**
+ * @brief Applies a batch of entries group by group, one lock acquisition
+ * per account per group.
+ *
+ * @details
+ * Accounts linked by a transfer in the batch end up in the same group, so
+ * every entry lies inside exactly one group. For each group, all of its
+ * accounts' locks are taken in ascending lock index order (the order
+ * transfer() uses, so this cannot deadlock against other consumers), its
+ * entries are applied in
+ * ledgerID order with the owner-only bank operations, and the accounts are
+ * unlocked. On a ledger with a few hot accounts most of a batch collapses
+ * into a handful of groups, so lock traffic drops by roughly the batch
+ * size.
+ *
+ * Outcomes are tallied locally and published with one countBatch() per
+ * batch. Log lines are still written per entry.
+ *
+ * @param workerID The consumer's ID.
+ * @param batch The entries; reordered in place.
+ * @param n The number of entries in `batch`.
+ * @param scratch The consumer's union-find, left empty.
+ */
+void commit_groups(int workerID, Ledger **batch, int n, GroupScratch &scratch) {
+  for (int i = 0; i < n; i++) {
+    Ledger *e = batch[i];
+    if (e->mode == T) scratch.unite(e->acc, e->other);
+  }
 
+  // group by root account, ledgerID order within a group
+  vector<pair<int, Ledger *>> order(n);
+  for (int i = 0; i < n; i++) order[i] = {scratch.find(batch[i]->acc), batch[i]};
+  sort(order.begin(), order.end(),
+       [](const pair<int, Ledger *> &a, const pair<int, Ledger *> &b) {
+         if (a.first != b.first) return a.first < b.first;
+         return a.second->ledgerID < b.second->ledgerID;
+       });
+
+  long succ = 0, fail = 0;
+  vector<int> accounts;
+  for (int begin = 0; begin < n;) {
+    int end = begin;
+    accounts.clear();
+    while (end < n && order[end].first == order[begin].first) {
+      Ledger *e = order[end++].second;
+      accounts.push_back(e->acc);
+      if (e->mode == T) accounts.push_back(e->other);
+    }
+    // one account per distinct lock, in lock order (see Bank::lockIndex())
+    sort(accounts.begin(), accounts.end(), [](int a, int b) {
+      return bank->lockIndex(a) < bank->lockIndex(b);
+    });
+    accounts.erase(unique(accounts.begin(), accounts.end(),
+                          [](int a, int b) {
+                            return bank->lockIndex(a) == bank->lockIndex(b);
+                          }),
+                   accounts.end());
+
+    for (int a : accounts) bank->lockAccount(workerID, a);
+    for (int i = begin; i < end; i++) {
+      Ledger *e = order[i].second;
+      int r = 0;
+      if (e->mode == D) {
+        r = bank->depositLocal(workerID, e->ledgerID, e->acc, e->amount, false);
+      } else if (e->mode == W) {
+        r = bank->withdrawLocal(workerID, e->ledgerID, e->acc, e->amount, false);
+      } else if (e->mode == T) {
+        r = bank->transferLocal(workerID, e->ledgerID, e->acc, e->other,
+                                e->amount, false);
+      } else {
+        continue;
+      }
+      (r == 0 ? succ : fail)++;
+    }
+    for (int k = accounts.size() - 1; k >= 0; k--) {
+      bank->unlockAccount(accounts[k]);
+    }
+
+    begin = end;
+  }
+
+  scratch.parent.clear();
+  bank->countBatch(workerID, succ, fail);
 }
 
 /**
@@ -158,93 +555,267 @@ int load_ledger(char *filename) {
  *
  * This function represents a consumer thread responsible for processing ledger
  * entries from the bounded buffer. Each thread is assigned a unique ID, and
- * they dequeue ledger entries one by one, performing deposit, withdraw, or
- * transfer operations based on the entry's mode. Threads continue processing
- * until the consumed items = number of ledger items.
+ * they dequeue ledger entries in batches of up to `opts.batch`, performing
+ * deposit, withdraw, or transfer operations based on the entry's mode. Threads
+ * continue processing until the consumed items = number of ledger items.
  *
  * @attention
  * - The workerID is a unique identifier assigned to each worker thread. Ensure
  * proper dereferencing.
  * - The function uses a mutex (ledger_lock) to ensure thread safety while
  * accessing the global ledger.
- * - It continuously dequeues ledger entries, processes them, and updates the
- * bank's state accordingly.
+ * - A consumer first claims k items against `con_items` under ledger_lock and
+ * then removes exactly k items with remove_up_to(), so the claims always add
+ * up to `max_items` and no consumer waits for an item that never comes.
  * - The worker handles deposit (D), withdraw (W), and transfer (T) operations
  * based on the ledger entry's mode.
+ * - With `opts.group_commit`, the whole claim is collected first and applied
+ * by commit_groups() instead of one process_entry() per item.
  *
  * @param workerID A pointer to the unique identifier of the worker thread.
  * @return NULL after completing ledger processing.
  */
 void *consumer(void *workerID) {
   int id = *((int*)workerID);
+  Ledger **batch = new Ledger*[opts.batch];
+  GroupScratch scratch;
+
   while(true){
     
-    pthread_mutex_lock(&ledger_lock);
+    STAT_LOCK(&ledger_lock, LOCK_CLASS_LEDGER, -1);
     if (con_items == max_items){
-      pthread_mutex_unlock(&ledger_lock);
-      //cout << "ENDED" << endl;
+      STAT_UNLOCK(&ledger_lock, LOCK_CLASS_LEDGER, -1);
       break;
     }
-    con_items++;
-    pthread_mutex_unlock(&ledger_lock);    
-    
-    Ledger* entry = bb->remove(); 
+    int claimed = min(opts.batch, max_items - con_items);
+    con_items += claimed;
+    STAT_UNLOCK(&ledger_lock, LOCK_CLASS_LEDGER, -1);    
     
+    if (opts.group_commit) {
+      int got = 0;
+      while (got < claimed) {
+        got += bb->remove_up_to(batch + got, claimed - got);
+      }
+      commit_groups(id, batch, got, scratch);
+      bank->syncWal();
+      if (trace_done != NULL) {
+        uint64_t now = trace_now();
+        for (int i = 0; i < got; i++) {
+          trace_done[batch[i] - ledger_arena.data()] = now;
+        }
+      }
+      continue;
+    }
 
-    if(entry->mode == D){
-      bank->deposit(id, entry->ledgerID, entry->acc, entry->amount);
+    while (claimed > 0) {
+      int n = bb->remove_up_to(batch, claimed);
+      for (int i = 0; i < n; i++) {
+        process_entry(id, batch[i]);
+        if (trace_done != NULL) {
+          trace_done[batch[i] - ledger_arena.data()] = trace_now();
+        }
+      }
+      claimed -= n;
     }
-    
-    else if(entry->mode == T){
-      bank->transfer(id, entry->ledgerID, entry->acc, entry->other, entry->amount);
+    bank->syncWal();
+  }
+
+  delete[] batch;
+  return NULL; 
+}
+
+/**
+ * @brief Claims up to `max` entries from the front of a producer's range.
+ *
+ * @param id The range (producer) to take from.
+ * @param max The most entries to claim.
+ * @param first Receives the arena index of the first claimed entry.
+ * @return The number of entries claimed, 0 if the range is empty.
+ */
+static int take_range(int id, int max, uint32_t *first) {
+  std::atomic<uint64_t> &span = ranges[id].span;
+  uint64_t v = span.load(std::memory_order_acquire);
+  while (true) {
+    uint32_t begin = range_begin(v), end = range_end(v);
+    if (begin >= end) return 0;
+    uint32_t k = min((uint32_t)max, end - begin);
+    if (span.compare_exchange_weak(v, pack_range(begin + k, end),
+                                   std::memory_order_acq_rel)) {
+      *first = begin;
+      return k;
     }
-    
-    else if(entry->mode == W){
-      bank->withdraw(id, entry->ledgerID, entry->acc, entry->amount);
+  }
+}
+
+/**
+ * @brief Refills producer `id`'s (empty) range by stealing the back half of
+ * the fullest other range.
+ *
+ * The victim keeps taking from its front while the thief cuts its end, and
+ * both go through a CAS on the same packed word, so every index is handed
+ * out exactly once. Ranges with fewer than two entries left are not worth
+ * stealing from; their owner finishes them.
+ *
+ * @return true if a new range was installed, false if nothing is left.
+ */
+static bool steal_range(int id) {
+  while (true) {
+    int victim = -1;
+    uint32_t most = 1;
+    uint64_t v = 0;
+    for (int i = 0; i < num_ranges; i++) {
+      uint64_t cur = ranges[i].span.load(std::memory_order_acquire);
+      uint32_t begin = range_begin(cur), end = range_end(cur);
+      if (i != id && begin < end && end - begin > most) {
+        victim = i;
+        most = end - begin;
+        v = cur;
+      }
+    }
+    if (victim < 0) return false;
+
+    uint32_t begin = range_begin(v), end = range_end(v);
+    uint32_t half = (end - begin) / 2;
+    if (ranges[victim].span.compare_exchange_strong(
+            v, pack_range(begin, end - half), std::memory_order_acq_rel)) {
+      ranges[id].span.store(pack_range(end - half, end),
+                            std::memory_order_release);
+      return true;
     }
-    //pthread_mutex_lock(&ledger_lock);
-    //con_items++;
-    //pthread_mutex_unlock(&ledger_lock); 
-    
   }
-  return NULL; 
 }
 
 /**
  * @brief Producer thread function that transfers ledger entries to the bounded buffer.
  *
- * This function acts as the producer. It repeatedly removes ledger
- * entries from a shared ledger container and appends them to a bounded buffer for further processing.
- * The function employs a mutex (ledger_lock) to ensure exclusive access to the shared ledger while
- * checking and modifying its contents.
+ * This function acts as the producer. It repeatedly claims ledger entries
+ * from its own contiguous range of `ledger_arena` and appends them to a
+ * bounded buffer for further processing. There is no global ledger lock:
+ * ranges are claimed and stolen with CAS on per-producer words.
  *
- * @param[in] unused A pointer to any data (unused in this implementation).
+ * @param[in] producerID A pointer to this producer's index into `ranges`.
  * @return Always returns NULL.
  *
  * @details
- * - While the ledger is not empty, it:
- *   - Retrieves the first ledger entry.
- *   - Removes the entry from the ledger.
- *   - Appends the entry to the bounded buffer.
+ * - While the ledger is not exhausted, it:
+ *   - Claims up to `opts.batch` entries off the front of its own range.
+ *   - If its range is empty, steals the back half of the fullest other
+ *     range and carries on with that.
+ *   - Appends the claimed span to the bounded buffer with append_n().
  *
  * @note The function should be thread-safe and ensure
- * that the ledger is empty after all entries have been processed.
+ * that every entry is handed out exactly once.
  */
-void* producer(void *) {
-  // TODO: producer thread, see instruction for implementation
+void* producer(void *producerID) {
+  int id = *((int*)producerID);
+  Ledger **batch = new Ledger*[opts.batch];
+
   while(true){
-    pthread_mutex_lock(&ledger_lock);
-    if(ledger.empty()){
-      //cout << "ERR: NOTHING IN LEDGER" << endl; 
-      pthread_mutex_unlock(&ledger_lock);
+    uint32_t first;
+    int n = take_range(id, opts.batch, &first);
+    if (n == 0) {
+      if (steal_range(id)) continue;
       break;
-    }  
-        Ledger* entry = ledger.front(); 
-        ledger.pop_front();
-        pthread_mutex_unlock(&ledger_lock);
+    }
 
-        bb->append(entry); 
+    for (int i = 0; i < n; i++) {
+      batch[i] = &ledger_arena[first + i];
+    }
+    if (trace_enqueue != NULL) {
+      uint64_t now = trace_now();
+      for (int i = 0; i < n; i++) trace_enqueue[first + i] = now;
     }
+    bb->append_n(batch, n);
+  }
 
+  delete[] batch;
   return NULL; 
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Producer for run_stream(): parses the next entries of the stream
+ * into free pool slots and appends them to the bounded buffer.
+ *
+ * @details
+ * - Waits for free slots first, so a producer never reads ahead of what
+ *   the consumers can take.
+ * - Entries the bank already holds (see already_applied()) and entries
+ *   naming accounts outside the bank are not forwarded; their slots go
+ *   straight back to the pool.
+ * - Returns once the stream is over.
+ *
+ * @param[in] producerID A pointer to this producer's index (unused).
+ * @return Always returns NULL.
+ */
+void *stream_producer(void *producerID) {
+  (void)producerID;
+  Ledger **batch = new Ledger*[opts.batch];
+  Ledger *parsed = new Ledger[opts.batch];
+  int accounts = bank->getNum();
+
+  while (true) {
+    int n = free_slots->remove_up_to(batch, opts.batch);
+    int got = ledger_stream->next(parsed, n);
+
+    int keep = 0;
+    for (int i = 0; i < got; i++) {
+      const Ledger &e = parsed[i];
+      if (already_applied(e.ledgerID)) continue;
+      if (e.acc < 0 || e.acc >= accounts ||
+          (e.mode == T && (e.other < 0 || e.other >= accounts))) {
+        stream_rejected++;
+        continue;
+      }
+      *batch[keep++] = e;
+    }
+    if (keep < n) free_slots->append_n(batch + keep, n - keep);
+    if (keep > 0) bb->append_n(batch, keep);
+    if (got == 0) break;
+  }
+
+  delete[] parsed;
+  delete[] batch;
+  return NULL;
+}
+
+/**
+ * @brief Consumer for run_stream(): applies entries until it removes an
+ * end-of-stream NULL.
+ *
+ * @details
+ * A batch may end in more than one NULL; all but one go back into the
+ * buffer for the other consumers. Entries are applied as in consumer(),
+ * grouped by account with `opts.group_commit`, and their slots are
+ * returned to the pool afterwards.
+ *
+ * @param workerID A pointer to the unique identifier of the worker thread.
+ * @return NULL after the end of the stream.
+ */
+void *stream_consumer(void *workerID) {
+  int id = *((int*)workerID);
+  Ledger **batch = new Ledger*[opts.batch];
+  GroupScratch scratch;
+  bool last = false;
+
+  while (!last) {
+    int n = bb->remove_up_to(batch, opts.batch);
+    int real = 0;
+    while (real < n && batch[real] != NULL) real++;
+    if (real < n) {
+      last = true;
+      if (n - real > 1) bb->append_n(batch + real + 1, n - real - 1);
+    }
+    if (real == 0) continue;
+
+    if (opts.group_commit) {
+      commit_groups(id, batch, real, scratch);
+    } else {
+      for (int i = 0; i < real; i++) process_entry(id, batch[i]);
+    }
+    bank->syncWal();
+    free_slots->append_n(batch, real);
+  }
+
+  delete[] batch;
+  return NULL;
+}
@@ -0,0 +1,532 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <ledgerFile.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// One loader thread's share of a text ledger.
+struct ParseChunk {
+  const char *begin;
+  const char *end;
+  vector<Ledger> rows;
+  bool error;    // hit something that is not an integer
+  bool partial;  // ended with 1-3 dangling integers
+};
+
+static inline bool is_space(char c) {
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' ||
+         c == '\f';
+}
+
+/**
+ * @brief Parses one decimal integer starting at `*p`, skipping leading
+ * whitespace first, the way `%d` does.
+ *
+ * @return 1 on success (with `*p` advanced past the digits), 0 at the end
+ * of the input, -1 if the next token is not an integer.
+ */
+static inline int parse_int(const char **p, const char *end, int *out) {
+  const char *s = *p;
+  while (s < end && is_space(*s)) s++;
+  if (s == end) {
+    *p = s;
+    return 0;
+  }
+
+  bool neg = false;
+  if (*s == '-' || *s == '+') {
+    neg = *s == '-';
+    s++;
+  }
+  if (s == end || (unsigned)(*s - '0') > 9) return -1;
+
+  unsigned v = 0;
+  while (s < end && (unsigned)(*s - '0') <= 9) {
+    v = v * 10 + (*s - '0');
+    s++;
+  }
+  *out = neg ? -(int)v : (int)v;
+  *p = s;
+  return 1;
+}
+
+/**
+ * @brief Loader thread body: turns [begin, end) into Ledger rows.
+ *
+ * Rows go into the chunk's own vector, reserved up front for the densest
+ * possible input ("0 0 0 0\n" is 8 bytes), so parsing never reallocates.
+ * ledgerIDs are assigned later, once every chunk's row count is known.
+ */
+static void *parse_chunk(void *arg) {
+  ParseChunk *chunk = (ParseChunk *)arg;
+  const char *p = chunk->begin;
+  chunk->rows.reserve((chunk->end - chunk->begin) / 8 + 1);
+  chunk->error = false;
+  chunk->partial = false;
+
+  while (true) {
+    int v[4];
+    int got = 0;
+    int r = 0;
+    while (got < 4 && (r = parse_int(&p, chunk->end, &v[got])) == 1) got++;
+    if (got == 4) {
+      chunk->rows.push_back(Ledger{v[0], v[1], v[2], v[3], 0});
+      continue;
+    }
+    chunk->error = r < 0;
+    chunk->partial = got > 0;
+    break;
+  }
+  return NULL;
+}
+
+/**
+ * @brief Parses a whole text ledger held in memory.
+ *
+ * @details
+ * The text is cut into up to `threads` chunks at newline boundaries and the
+ * chunks are parsed concurrently, each into its own pre-sized vector. The
+ * chunks are then concatenated into `out` in file order and numbered, so
+ * ledgerIDs match a sequential read.
+ *
+ * The result is the same as reading the file with repeated
+ * `fscanf("%d %d %d %d")`: parsing stops at the first token that is not an
+ * integer and a trailing incomplete record is dropped. Chunking assumes one
+ * record per line; if a chunk ends in the middle of a record the text is
+ * simply reparsed on one thread.
+ *
+ * @param data The ledger text.
+ * @param len Its length in bytes.
+ * @param out Receives the parsed entries (previous contents are replaced).
+ * @param threads The maximum number of parser threads (>= 1).
+ * @return The number of entries parsed.
+ */
+int parse_ledger_text(const char *data, size_t len, vector<Ledger> &out,
+                      int threads) {
+  int n = (int)min((size_t)max(threads, 1), len / LOAD_MIN_CHUNK + 1);
+  vector<ParseChunk> chunks(n);
+
+  const char *at = data;
+  const char *end = data + len;
+  for (int i = 0; i < n; i++) {
+    const char *stop = (i == n - 1) ? end : data + len / n * (i + 1);
+    if (stop < at) stop = at;
+    const char *nl = (const char *)memchr(stop, '\n', end - stop);
+    chunks[i].begin = at;
+    chunks[i].end = (i == n - 1 || nl == NULL) ? end : nl + 1;
+    at = chunks[i].end;
+  }
+
+  vector<pthread_t> tids(n);
+  for (int i = 1; i < n; i++) {
+    int check = pthread_create(&tids[i], NULL, parse_chunk, &chunks[i]);
+    assert(check == 0);
+  }
+  parse_chunk(&chunks[0]);
+  for (int i = 1; i < n; i++) {
+    pthread_join(tids[i], NULL);
+  }
+
+  // Keep chunks up to and including the first one that stopped early.
+  size_t total = 0;
+  int used = 0;
+  while (used < n) {
+    ParseChunk &c = chunks[used++];
+    total += c.rows.size();
+    if (c.error) break;
+    if (c.partial && used < n) {
+      ParseChunk whole = {data, end, {}, false, false};
+      parse_chunk(&whole);
+      chunks.clear();
+      chunks.push_back(move(whole));
+      total = chunks[0].rows.size();
+      used = 1;
+      break;
+    }
+  }
+
+  out.clear();
+  out.reserve(total);
+  for (int i = 0; i < used; i++) {
+    out.insert(out.end(), chunks[i].rows.begin(), chunks[i].rows.end());
+  }
+  for (size_t i = 0; i < out.size(); i++) {
+    out[i].ledgerID = i;
+  }
+  return out.size();
+}
+
+static size_t align8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+/**
+ * @brief Checks whether a mapped ledger starts with the binary header.
+ */
+bool is_binary_ledger(const char *data, size_t len) {
+  return len >= sizeof(LedgerFileHeader) &&
+         memcmp(data, LEDGER_MAGIC, 4) == 0;
+}
+
+// Reads/writes column element i as a signed (delta) or unsigned (offset)
+// integer of `width` bytes.
+static long get_id(const char *col, int width, size_t i, bool is_signed) {
+  switch (width) {
+    case 1:
+      return is_signed ? (long)((const int8_t *)col)[i]
+                       : (long)((const uint8_t *)col)[i];
+    case 2:
+      return is_signed ? (long)((const int16_t *)col)[i]
+                       : (long)((const uint16_t *)col)[i];
+    default:
+      return is_signed ? (long)((const int32_t *)col)[i]
+                       : (long)((const uint32_t *)col)[i];
+  }
+}
+
+static void put_id(char *col, int width, size_t i, long v) {
+  switch (width) {
+    case 1:
+      ((uint8_t *)col)[i] = (uint8_t)v;
+      break;
+    case 2:
+      ((uint16_t *)col)[i] = (uint16_t)v;
+      break;
+    default:
+      ((uint32_t *)col)[i] = (uint32_t)v;
+  }
+}
+
+// Smallest of 1, 2, 4 bytes that holds every value in [lo, hi].
+static int id_width(long lo, long hi, bool is_signed) {
+  if (is_signed ? (lo >= INT8_MIN && hi <= INT8_MAX) : hi <= UINT8_MAX) {
+    return 1;
+  }
+  if (is_signed ? (lo >= INT16_MIN && hi <= INT16_MAX) : hi <= UINT16_MAX) {
+    return 2;
+  }
+  return 4;
+}
+
+/**
+ * @brief Decodes a binary ledger held in memory.
+ *
+ * @details
+ * The columns are read straight out of `data` (normally the mmapped file)
+ * and interleaved into Ledger rows in one sequential pass; there is no
+ * parsing, so this runs at memory bandwidth.
+ *
+ * @param data The file contents.
+ * @param len Their length in bytes.
+ * @param out Receives the entries, with ledgerIDs from 0.
+ * @param header If not NULL, receives a copy of the file header.
+ * @return The number of entries, or -1 if the file is truncated or
+ * malformed.
+ */
+int decode_ledger_binary(const char *data, size_t len, vector<Ledger> &out,
+                         LedgerFileHeader *header) {
+  if (!is_binary_ledger(data, len)) return -1;
+
+  LedgerFileHeader h;
+  memcpy(&h, data, sizeof(h));
+  int w = h.id_bytes;
+  if (h.version != LEDGER_VERSION || (w != 1 && w != 2 && w != 4) ||
+      h.count > (uint64_t)INT32_MAX) {
+    return -1;
+  }
+
+  size_t n = h.count;
+  size_t acc_at = align8(sizeof(h));
+  size_t other_at = acc_at + align8(n * w);
+  size_t amount_at = other_at + align8(n * w);
+  size_t mode_at = amount_at + align8(n * sizeof(int32_t));
+  if (mode_at + n > len) return -1;
+
+  const char *acc = data + acc_at;
+  const char *other = data + other_at;
+  const int32_t *amount = (const int32_t *)(data + amount_at);
+  const uint8_t *mode = (const uint8_t *)(data + mode_at);
+  bool delta = h.flags & LEDGER_DELTA;
+
+  out.resize(n);
+  long prev_acc = h.id_base, prev_other = h.id_base;
+  for (size_t i = 0; i < n; i++) {
+    long a = get_id(acc, w, i, delta);
+    long o = get_id(other, w, i, delta);
+    if (delta) {
+      a = prev_acc += a;
+      o = prev_other += o;
+    } else {
+      a += h.id_base;
+      o += h.id_base;
+    }
+    out[i] = Ledger{(int)a, (int)o, amount[i], mode[i], (int)i};
+  }
+
+  if (header != NULL) *header = h;
+  return n;
+}
+
+/**
+ * @brief Writes `rows` as a binary ledger.
+ *
+ * The ID column width is the narrowest that fits; with `delta` the IDs
+ * are stored as differences (see LEDGER_DELTA), which only helps if the
+ * deltas are narrower than the plain offsets, so the flag is dropped
+ * when they are not.
+ *
+ * @return 0 on success, -1 on I/O error or if a mode does not fit a byte.
+ */
+int write_ledger_binary(const char *filename, const vector<Ledger> &rows,
+                        bool delta) {
+  size_t n = rows.size();
+  LedgerFileHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, LEDGER_MAGIC, 4);
+  h.version = LEDGER_VERSION;
+  h.count = n;
+
+  // [lo, hi] spans every stored ID; [min_acc, max_acc] only the accounts
+  // the ledger touches
+  long lo = n ? rows[0].acc : 0, hi = lo;
+  int min_acc = lo, max_acc = lo;
+  for (const Ledger &r : rows) {
+    if (r.mode < 0 || r.mode > UINT8_MAX) return -1;
+    lo = min(lo, (long)min(r.acc, r.other));
+    hi = max(hi, (long)max(r.acc, r.other));
+    min_acc = min(min_acc, r.acc);
+    max_acc = max(max_acc, r.acc);
+    if (r.mode == T) {
+      min_acc = min(min_acc, r.other);
+      max_acc = max(max_acc, r.other);
+    }
+  }
+  h.id_base = lo;
+  h.min_acc = min_acc;
+  h.max_acc = max_acc;
+
+  int plain = id_width(0, hi - lo, false);
+  long dlo = 0, dhi = 0, prev_acc = lo, prev_other = lo;
+  for (const Ledger &r : rows) {
+    dlo = min(dlo, min(r.acc - prev_acc, r.other - prev_other));
+    dhi = max(dhi, max(r.acc - prev_acc, r.other - prev_other));
+    prev_acc = r.acc;
+    prev_other = r.other;
+  }
+  int deltas = id_width(dlo, dhi, true);
+  delta = delta && deltas < plain;
+  h.flags = delta ? LEDGER_DELTA : 0;
+  h.id_bytes = delta ? deltas : plain;
+
+  int w = h.id_bytes;
+  size_t acc_at = align8(sizeof(h));
+  size_t other_at = acc_at + align8(n * w);
+  size_t amount_at = other_at + align8(n * w);
+  size_t mode_at = amount_at + align8(n * sizeof(int32_t));
+  vector<char> buf(mode_at + n, 0);
+
+  memcpy(buf.data(), &h, sizeof(h));
+  prev_acc = prev_other = lo;
+  for (size_t i = 0; i < n; i++) {
+    const Ledger &r = rows[i];
+    put_id(buf.data() + acc_at, w, i, delta ? r.acc - prev_acc : r.acc - lo);
+    put_id(buf.data() + other_at, w, i,
+           delta ? r.other - prev_other : r.other - lo);
+    ((int32_t *)(buf.data() + amount_at))[i] = r.amount;
+    ((uint8_t *)(buf.data() + mode_at))[i] = r.mode;
+    prev_acc = r.acc;
+    prev_other = r.other;
+  }
+
+  FILE *f = fopen(filename, "wb");
+  if (f == NULL) return -1;
+  bool ok = fwrite(buf.data(), 1, buf.size(), f) == buf.size();
+  return (fclose(f) == 0 && ok) ? 0 : -1;
+}
+
+/**
+ * @brief Writes `rows` in the text format load_ledger() reads.
+ *
+ * @return 0 on success, -1 on I/O error.
+ */
+int write_ledger_text(const char *filename, const vector<Ledger> &rows) {
+  FILE *f = fopen(filename, "w");
+  if (f == NULL) return -1;
+  for (const Ledger &r : rows) {
+    fprintf(f, "%d %d %d %d\n", r.acc, r.other, r.amount, r.mode);
+  }
+  return fclose(f) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Maps a ledger file into memory and loads it.
+ *
+ * Binary ledgers (see LedgerFileHeader) are recognised by their magic
+ * number and decoded directly from the mapping; anything else is parsed
+ * as text with parse_ledger_text().
+ *
+ * @param filename The ledger file.
+ * @param out Receives the entries, in file order, with ledgerIDs from 0.
+ * @param threads The maximum number of parser threads.
+ * @param header If not NULL, receives the header of a binary ledger; its
+ * magic is left zeroed for a text ledger.
+ * @return The number of entries, or -1 if the file cannot be opened/mapped
+ * or is a malformed binary ledger.
+ */
+int read_ledger_file(const char *filename, vector<Ledger> &out, int threads,
+                     LedgerFileHeader *header) {
+  if (header != NULL) memset(header, 0, sizeof(*header));
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    out.clear();
+    return 0;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return -1;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  int n;
+  if (is_binary_ledger((const char *)map, st.st_size)) {
+    n = decode_ledger_binary((const char *)map, st.st_size, out, header);
+  } else {
+    n = parse_ledger_text((const char *)map, st.st_size, out, threads);
+  }
+  munmap(map, st.st_size);
+  return n;
+}
+
+/**
+ * @brief Opens `filename` for streaming; "-" reads stdin.
+ *
+ * A binary ledger cannot be streamed (its columns are laid out one after
+ * the other), so one is rejected here: ok() is false afterwards, as it is
+ * when the file cannot be opened.
+ */
+LedgerStream::LedgerStream(const char *filename)
+    : fd(-1), owns_fd(false), buf(NULL), cap(LEDGER_STREAM_CHUNK), pos(0),
+      len(0), eof(false), done(false), next_id(0) {
+  pthread_mutex_init(&lock, NULL);
+  buf = new char[cap];
+  if (strcmp(filename, "-") == 0) {
+    fd = STDIN_FILENO;
+  } else {
+    fd = open(filename, O_RDONLY);
+    owns_fd = true;
+  }
+  if (fd < 0) return;
+
+  // peek far enough to tell a binary ledger from text
+  while (!eof && len < sizeof(LedgerFileHeader)) fill();
+  if (is_binary_ledger(buf, len)) {
+    if (owns_fd) close(fd);
+    fd = -1;
+  }
+}
+
+LedgerStream::~LedgerStream() {
+  if (fd >= 0 && owns_fd) close(fd);
+  delete[] buf;
+  pthread_mutex_destroy(&lock);
+}
+
+/**
+ * @brief Moves the unparsed tail to the front of the buffer and reads more
+ * after it, doubling the buffer only if one record fills all of it.
+ *
+ * @return false once the file has ended or cannot be read any more.
+ */
+bool LedgerStream::fill() {
+  if (pos > 0) {
+    memmove(buf, buf + pos, len - pos);
+    len -= pos;
+    pos = 0;
+  }
+  if (len == cap) {
+    char *bigger = new char[cap * 2];
+    memcpy(bigger, buf, len);
+    delete[] buf;
+    buf = bigger;
+    cap *= 2;
+  }
+
+  ssize_t r;
+  do {
+    r = read(fd, buf + len, cap - len);
+  } while (r < 0 && errno == EINTR);
+  if (r <= 0) {
+    eof = true;
+    return false;
+  }
+  len += r;
+  return true;
+}
+
+/**
+ * @brief Parses up to `max` more entries, blocking on the file as needed.
+ *
+ * @details
+ * Only whole lines are parsed until the file ends, so a number split
+ * across two reads is never mistaken for two shorter ones. As with
+ * parse_ledger_text(), parsing stops for good at the first token that is
+ * not an integer, and an incomplete record at the very end is dropped.
+ *
+ * Memory is one read buffer (LEDGER_STREAM_CHUNK) no matter how long the
+ * stream is.
+ *
+ * @param out Receives the entries.
+ * @param max The most entries to return.
+ * @return The number of entries parsed; 0 once the stream is over.
+ */
+int LedgerStream::next(Ledger *out, int max) {
+  pthread_mutex_lock(&lock);
+  int n = 0;
+  while (n < max && !done) {
+    size_t limit = len;
+    if (!eof) {
+      const char *nl = (const char *)memrchr(buf + pos, '\n', len - pos);
+      limit = nl == NULL ? pos : nl + 1 - buf;
+    }
+
+    const char *p = buf + pos;
+    const char *end = buf + limit;
+    while (n < max) {
+      const char *record = p;
+      int v[4];
+      int got = 0;
+      int r = 0;
+      while (got < 4 && (r = parse_int(&p, end, &v[got])) == 1) got++;
+      if (got == 4) {
+        out[n++] = Ledger{v[0], v[1], v[2], v[3], next_id++};
+        pos = p - buf;
+        continue;
+      }
+      if (r < 0) {
+        done = true;
+      } else if (eof) {
+        done = true;
+      } else {
+        pos = record - buf;  // a record across lines: wait for the rest
+      }
+      break;
+    }
+
+    if (n < max && !done) fill();
+  }
+  pthread_mutex_unlock(&lock);
+  return n;
+}
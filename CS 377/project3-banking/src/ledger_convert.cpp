@@ -0,0 +1,49 @@
+#include <ledgerFile.h>
+#include <unistd.h>
+
+// Converts between the text and binary ledger formats. The input format
+// is detected automatically; the output is binary unless -t is given.
+
+static void usage(char *prog) {
+  cerr << "Usage: " << prog << " [-d | -t] <input_ledger> <output_ledger>\n"
+       << "  -d  delta-encode account IDs in the binary output\n"
+       << "  -t  write the text format instead of binary\n"
+       << endl;
+  exit(-1);
+}
+
+int main(int argc, char *argv[]) {
+  bool delta = false, text = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "dt")) != -1) {
+    switch (opt) {
+      case 'd':
+        delta = true;
+        break;
+      case 't':
+        text = true;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (argc - optind != 2 || (delta && text)) {
+    usage(argv[0]);
+  }
+
+  vector<Ledger> rows;
+  int threads = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+  if (read_ledger_file(argv[optind], rows, threads) < 0) {
+    cerr << "ERR: cannot read " << argv[optind] << endl;
+    return 1;
+  }
+
+  int check = text ? write_ledger_text(argv[optind + 1], rows)
+                   : write_ledger_binary(argv[optind + 1], rows, delta);
+  if (check < 0) {
+    cerr << "ERR: cannot write " << argv[optind + 1] << endl;
+    return 1;
+  }
+  cout << "converted " << rows.size() << " entries" << endl;
+  return 0;
+}
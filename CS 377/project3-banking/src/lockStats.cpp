@@ -0,0 +1,173 @@
+#include <lockStats.h>
+#include <time.h>
+#include <atomic>
+
+// Live counters behind a LockStat, on their own cache line.
+struct LockCounters {
+  alignas(64) std::atomic<long> acquired;
+  std::atomic<long> contended;
+  std::atomic<long> wait_ns;
+  std::atomic<long> max_wait_ns;
+  std::atomic<long> hold_ns;
+};
+
+static LockCounters classes[LOCK_CLASSES];
+static LockCounters accounts[LOCK_STATS_ACCOUNTS];
+
+static const char *class_names[LOCK_CLASSES] = {"buffer", "bank", "ledger",
+                                                "account"};
+
+// Locks the calling thread holds, with the time each was acquired.
+struct HeldLock {
+  pthread_mutex_t *lock;
+  long since;
+};
+static thread_local HeldLock held[LOCK_STATS_HELD];
+static thread_local int num_held;
+
+static long now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void add(LockCounters &c, bool contended, long wait) {
+  c.acquired.fetch_add(1, std::memory_order_relaxed);
+  if (!contended) return;
+  c.contended.fetch_add(1, std::memory_order_relaxed);
+  c.wait_ns.fetch_add(wait, std::memory_order_relaxed);
+  long max = c.max_wait_ns.load(std::memory_order_relaxed);
+  while (wait > max && !c.max_wait_ns.compare_exchange_weak(
+                           max, wait, std::memory_order_relaxed)) {
+  }
+}
+
+static void acquired(pthread_mutex_t *lock, int cls, int account,
+                     bool contended, long wait) {
+  add(classes[cls], contended, wait);
+  if (account >= 0 && account < LOCK_STATS_ACCOUNTS) {
+    add(accounts[account], contended, wait);
+  }
+  if (num_held < LOCK_STATS_HELD) {
+    held[num_held++] = {lock, now_ns()};
+  }
+}
+
+static void released(pthread_mutex_t *lock, int cls, int account) {
+  for (int i = num_held - 1; i >= 0; i--) {
+    if (held[i].lock != lock) continue;
+    long hold = now_ns() - held[i].since;
+    held[i] = held[--num_held];
+    classes[cls].hold_ns.fetch_add(hold, std::memory_order_relaxed);
+    if (account >= 0 && account < LOCK_STATS_ACCOUNTS) {
+      accounts[account].hold_ns.fetch_add(hold, std::memory_order_relaxed);
+    }
+    return;
+  }
+}
+
+/**
+ * @brief pthread_mutex_lock() that records the acquisition.
+ *
+ * A lock that is free on the first trylock counts as uncontended; otherwise
+ * the blocking lock is timed and the wait is recorded against the class and,
+ * for account locks, the account.
+ *
+ * @param cls One of the LOCK_CLASS_* values.
+ * @param account The account ID, or -1 for locks that guard no account.
+ */
+void stat_lock(pthread_mutex_t *lock, int cls, int account) {
+  if (pthread_mutex_trylock(lock) == 0) {
+    acquired(lock, cls, account, false, 0);
+    return;
+  }
+  long start = now_ns();
+  pthread_mutex_lock(lock);
+  acquired(lock, cls, account, true, now_ns() - start);
+}
+
+/**
+ * @brief pthread_mutex_trylock() that records an uncontended acquisition
+ * when it gets the lock.
+ *
+ * @return 0 if the lock was taken, as pthread_mutex_trylock().
+ */
+int stat_trylock(pthread_mutex_t *lock, int cls, int account) {
+  int r = pthread_mutex_trylock(lock);
+  if (r == 0) {
+    acquired(lock, cls, account, false, 0);
+  }
+  return r;
+}
+
+/**
+ * @brief pthread_mutex_unlock() that records how long the lock was held.
+ */
+void stat_unlock(pthread_mutex_t *lock, int cls, int account) {
+  released(lock, cls, account);
+  pthread_mutex_unlock(lock);
+}
+
+/**
+ * @brief pthread_cond_wait() on a lock taken with stat_lock().
+ *
+ * Time asleep on the condition is not hold time, so the hold ends before the
+ * wait and a new, uncontended acquisition starts after it.
+ */
+int stat_cond_wait(pthread_cond_t *cond, pthread_mutex_t *lock, int cls,
+                   int account) {
+  released(lock, cls, account);
+  int r = pthread_cond_wait(cond, lock);
+  acquired(lock, cls, account, false, 0);
+  return r;
+}
+
+static LockStat snapshot(LockCounters &c) {
+  return {c.acquired.load(), c.contended.load(), c.wait_ns.load(),
+          c.max_wait_ns.load(), c.hold_ns.load()};
+}
+
+LockStat lock_stats_class(int cls) { return snapshot(classes[cls]); }
+
+LockStat lock_stats_account(int account) { return snapshot(accounts[account]); }
+
+static void clear(LockCounters &c) {
+  c.acquired = 0;
+  c.contended = 0;
+  c.wait_ns = 0;
+  c.max_wait_ns = 0;
+  c.hold_ns = 0;
+}
+
+/**
+ * @brief Zeroes every counter. Not safe against concurrent stat_lock().
+ */
+void lock_stats_reset() {
+  for (LockCounters &c : classes) clear(c);
+  for (LockCounters &c : accounts) clear(c);
+}
+
+static void print_row(ostream &out, const string &name, const LockStat &s) {
+  char line[160];
+  snprintf(line, sizeof(line), "%-12s %10ld %10ld %10.3f %12.1f %10.3f",
+           name.c_str(), s.acquired, s.contended, s.wait_ns / 1e6,
+           s.max_wait_ns / 1e3, s.hold_ns / 1e6);
+  out << line << endl;
+}
+
+/**
+ * @brief Prints one row per lock class and per account lock that was ever
+ * taken.
+ */
+void lock_stats_report(ostream &out) {
+  out << "Lock statistics:" << endl;
+  out << "lock           acquired  contended    wait_ms  max_wait_us    hold_ms"
+      << endl;
+  for (int cls = 0; cls < LOCK_CLASSES; cls++) {
+    print_row(out, class_names[cls], lock_stats_class(cls));
+  }
+  for (int a = 0; a < LOCK_STATS_ACCOUNTS; a++) {
+    LockStat s = lock_stats_account(a);
+    if (s.acquired > 0) print_row(out, "  acc " + to_string(a), s);
+  }
+}
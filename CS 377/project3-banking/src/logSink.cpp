@@ -0,0 +1,171 @@
+#include <assert.h>
+#include <logSink.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+// How long the writer naps when every ring is empty.
+#define LOG_IDLE_NS 50000
+
+static std::atomic<uint64_t> next_sink_id{1};
+
+// Each thread caches the ring it registered with the most recent sink it
+// posted to. Sinks are identified by a never-reused id, so a new sink that
+// happens to reuse an old one's address does not pick up a stale ring.
+struct LocalRing {
+  uint64_t sink_id;
+  void *ring;
+};
+static thread_local LocalRing local_ring = {0, NULL};
+
+/**
+ * @brief Creates the sink and starts its writer thread.
+ *
+ * @param out The stream the writer thread appends lines to.
+ */
+LogSink::LogSink(ostream &out) : out(out) {
+  id = next_sink_id.fetch_add(1);
+  buffers.store(NULL);
+  stop.store(false);
+  flush_req.store(0);
+  flush_ack.store(0);
+
+  int check = pthread_create(&thread, NULL, writer, this);
+  assert(check == 0);
+}
+
+/**
+ * @brief Stops the writer after a final drain and frees every ring.
+ *
+ * @attention
+ * - All posting threads must be done posting (e.g. joined) before the sink
+ *   is destroyed.
+ */
+LogSink::~LogSink() {
+  stop.store(true, std::memory_order_release);
+  pthread_join(thread, NULL);
+
+  ThreadBuffer *b = buffers.load();
+  while (b != NULL) {
+    ThreadBuffer *next = b->next;
+    delete b;
+    b = next;
+  }
+}
+
+/**
+ * @brief Returns the calling thread's ring, registering one on first use.
+ *
+ * Registration pushes onto a lock-free list; rings are never unlinked while
+ * the sink is alive, so the writer can walk the list without coordination.
+ */
+LogSink::ThreadBuffer *LogSink::local() {
+  if (local_ring.sink_id == id) {
+    return (ThreadBuffer *)local_ring.ring;
+  }
+
+  ThreadBuffer *b = new ThreadBuffer;
+  b->head.store(0, std::memory_order_relaxed);
+  b->tail.store(0, std::memory_order_relaxed);
+  b->next = buffers.load(std::memory_order_relaxed);
+  while (!buffers.compare_exchange_weak(b->next, b,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+  }
+
+  local_ring.sink_id = id;
+  local_ring.ring = b;
+  return b;
+}
+
+/**
+ * @brief Queues one line (including its trailing newline) for the writer.
+ *
+ * Copies into the caller's ring and publishes it with a single release
+ * store. If the ring is full the caller yields until the writer catches up.
+ *
+ * @param line The text to write.
+ * @param len Its length in bytes, at most LOG_LINE_MAX.
+ */
+void LogSink::post(const char *line, int len) {
+  assert(len >= 0 && len <= LOG_LINE_MAX);
+  ThreadBuffer *b = local();
+
+  size_t tail = b->tail.load(std::memory_order_relaxed);
+  while (tail + len - b->head.load(std::memory_order_acquire) >
+         LOG_BUFFER_SIZE) {
+    sched_yield();
+  }
+
+  size_t at = tail % LOG_BUFFER_SIZE;
+  size_t first = min((size_t)len, (size_t)LOG_BUFFER_SIZE - at);
+  memcpy(b->data + at, line, first);
+  memcpy(b->data, line + first, len - first);
+  b->tail.store(tail + len, std::memory_order_release);
+}
+
+/**
+ * @brief Waits until everything this thread posted has been written and
+ * `out` has been flushed.
+ */
+void LogSink::flush() {
+  uint64_t req = flush_req.fetch_add(1) + 1;
+  while (flush_ack.load(std::memory_order_acquire) < req) {
+    sched_yield();
+  }
+}
+
+/**
+ * @brief Copies every ring's published bytes to `out`.
+ *
+ * @return true if anything was written.
+ */
+bool LogSink::drain() {
+  bool wrote = false;
+  for (ThreadBuffer *b = buffers.load(std::memory_order_acquire); b != NULL;
+       b = b->next) {
+    size_t head = b->head.load(std::memory_order_relaxed);
+    size_t tail = b->tail.load(std::memory_order_acquire);
+    if (head == tail) continue;
+
+    size_t at = head % LOG_BUFFER_SIZE;
+    size_t first = min(tail - head, (size_t)LOG_BUFFER_SIZE - at);
+    out.write(b->data + at, first);
+    out.write(b->data, tail - head - first);
+    b->head.store(tail, std::memory_order_release);
+    wrote = true;
+  }
+  return wrote;
+}
+
+/**
+ * @brief Writer thread: drain, flush once the rings run dry, acknowledge
+ * flush requests, nap when idle.
+ *
+ * A flush request is read before the drain pass, so every line posted
+ * before the request was made is covered by the pass that acknowledges it.
+ */
+void *LogSink::writer(void *arg) {
+  LogSink *sink = (LogSink *)arg;
+  struct timespec idle = {0, LOG_IDLE_NS};
+  bool dirty = false;
+
+  while (true) {
+    bool stopping = sink->stop.load(std::memory_order_acquire);
+    uint64_t req = sink->flush_req.load(std::memory_order_acquire);
+    bool wrote = sink->drain();
+    bool requested = req != sink->flush_ack.load(std::memory_order_relaxed);
+    dirty = dirty || wrote;
+
+    if (dirty && (!wrote || requested)) {
+      sink->out.flush();
+      dirty = false;
+    }
+    if (requested) {
+      sink->flush_ack.store(req, std::memory_order_release);
+    }
+    if (stopping && !wrote) break;
+    if (!wrote) nanosleep(&idle, NULL);
+  }
+  return NULL;
+}
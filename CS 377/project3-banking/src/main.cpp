@@ -1,16 +1,158 @@
 #include <ledger.h>
+#include <string.h>
+#include <unistd.h>
+
+static void usage(char *prog) {
+  cerr << "Usage: " << prog
+       << " [-l] [-a] [-q] [-x] [-g] [-z] [-S] [-b batch] [-L layout] [-j threads] [-m mode] [-n accounts] [-s stripes] [-C file [-E entries]] [-R file] [-W file [-D level] [-F usec]] <num_producers> <num_consumers> <bb_size> <leader_file>\n"
+       << "  -l        use the lock-free ring for the bounded buffer\n"
+       << "  -a        log transactions asynchronously\n"
+       << "  -q        do not log individual transactions\n"
+       << "  -x        lock-free deposits/withdrawals on atomic balances\n"
+       << "  -g        consumers apply each batch grouped by account, one lock\n"
+       << "            per account per group\n"
+       << "  -S        stream the ledger: parse it while it runs instead of\n"
+       << "            loading it first (shared mode only; - reads stdin)\n"
+       << "  -b batch  ledger entries moved per buffer operation (default "
+       << opts.batch << ")\n"
+       << "  -L layout account layout: packed (default), padded or soa\n"
+       << "  -j threads ledger parser threads (default: one per CPU)\n"
+       << "  -n accounts number of accounts (default 10), or auto to size the bank\n"
+       << "            from the ledger\n"
+       << "  -s stripes guard accounts with this many lock stripes\n"
+       << "  -z        allocate accounts lazily, a page at a time, on first touch\n"
+       << "  -m mode   execution mode: shared (default), sharded or\n"
+       << "            deterministic\n"
+       << "  -C file   write a snapshot of the bank to file as the ledger runs\n"
+       << "            (deterministic mode only)\n"
+       << "  -E entries ledger entries between snapshots (default "
+       << opts.checkpoint_every << ")\n"
+       << "  -R file   restore the snapshot in file and resume after its last\n"
+       << "            ledger entry\n"
+       << "  -W file   append every outcome to a write-ahead log, replaying it\n"
+       << "            first if it exists\n"
+       << "  -D level  log durability: async (never fsync), group (default,\n"
+       << "            fsync every interval) or sync (consumers wait for it)\n"
+       << "  -F usec   group commit interval (default " << opts.wal_interval_us
+       << ")\n"
+       << endl;
+  exit(-1);
+}
 
 int main(int argc, char* argv[]) {
 
-  if (argc != 5) {
-    cerr << "Usage: " << argv[0] << " <num_producers> <num_consumers> <bb_size> <leader_file>\n" << endl;
-    exit(-1);
+  int opt;
+  while ((opt = getopt(argc, argv, "laqxgzSb:L:j:m:n:s:C:E:R:W:D:F:")) != -1) {
+    switch (opt) {
+      case 'l':
+        opts.bb_mode = BB_LOCKFREE;
+        break;
+      case 'a':
+        opts.bank_flags |= BANK_ASYNC_LOG;
+        break;
+      case 'q':
+        opts.bank_flags |= BANK_QUIET;
+        break;
+      case 'x':
+        opts.bank_flags |= BANK_ATOMIC;
+        break;
+      case 'z':
+        opts.bank_flags |= BANK_LAZY;
+        break;
+      case 'S':
+        opts.stream = 1;
+        break;
+      case 'n':
+        if (strcmp(optarg, "auto") == 0) {
+          opts.accounts = 0;
+        } else {
+          opts.accounts = atoi(optarg);
+          if (opts.accounts < 1) usage(argv[0]);
+        }
+        break;
+      case 's':
+        opts.stripes = atoi(optarg);
+        if (opts.stripes < 1) usage(argv[0]);
+        break;
+      case 'C':
+        opts.checkpoint_file = optarg;
+        break;
+      case 'E':
+        opts.checkpoint_every = atol(optarg);
+        if (opts.checkpoint_every < 1) usage(argv[0]);
+        break;
+      case 'R':
+        opts.restore_file = optarg;
+        break;
+      case 'W':
+        opts.wal_file = optarg;
+        break;
+      case 'D':
+        if (strcmp(optarg, "async") == 0) {
+          opts.wal_level = WAL_ASYNC;
+        } else if (strcmp(optarg, "group") == 0) {
+          opts.wal_level = WAL_GROUP;
+        } else if (strcmp(optarg, "sync") == 0) {
+          opts.wal_level = WAL_SYNC;
+        } else {
+          usage(argv[0]);
+        }
+        break;
+      case 'F':
+        opts.wal_interval_us = atoi(optarg);
+        if (opts.wal_interval_us < 1) usage(argv[0]);
+        break;
+      case 'g':
+        opts.group_commit = 1;
+        break;
+      case 'b':
+        opts.batch = atoi(optarg);
+        if (opts.batch < 1) usage(argv[0]);
+        break;
+      case 'j':
+        opts.load_threads = atoi(optarg);
+        break;
+      case 'm':
+        if (strcmp(optarg, "sharded") == 0) {
+          opts.exec_mode = EXEC_SHARDED;
+        } else if (strcmp(optarg, "deterministic") == 0) {
+          opts.exec_mode = EXEC_DETERMINISTIC;
+        } else if (strcmp(optarg, "shared") != 0) {
+          usage(argv[0]);
+        }
+        break;
+      case 'L':
+        if (strcmp(optarg, "padded") == 0) {
+          opts.bank_flags |= BANK_PADDED;
+        } else if (strcmp(optarg, "soa") == 0) {
+          opts.bank_flags |= BANK_SOA;
+        } else if (strcmp(optarg, "packed") != 0) {
+          usage(argv[0]);
+        }
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  if (argc - optind != 4) {
+    usage(argv[0]);
+  }
+  if (opts.checkpoint_file != NULL && opts.exec_mode != EXEC_DETERMINISTIC) {
+    cerr << "-C needs -m deterministic: only its window barriers see a "
+            "prefix of the ledger fully applied" << endl;
+    usage(argv[0]);
+  }
+  if (opts.stream && (opts.exec_mode != EXEC_SHARED || opts.accounts == 0)) {
+    cerr << "-S needs -m shared and a fixed -n: the other modes and auto "
+            "sizing look at the whole ledger first" << endl;
+    usage(argv[0]);
   }
 
-  int p = atoi(argv[1]);       // number of producer threads
-  int c = atoi(argv[2]);       // number of consumer threads
-  int size = atoi(argv[3]);   // size of the bounded buffer
-  InitBank(p, c, size, argv[4]);
+  int p = atoi(argv[optind]);         // number of producer threads
+  int c = atoi(argv[optind + 1]);     // number of consumer threads
+  int size = atoi(argv[optind + 2]);  // size of the bounded buffer
+  InitBank(p, c, size, argv[optind + 3]);
 
   return 0;
 }
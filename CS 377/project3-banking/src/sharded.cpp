@@ -0,0 +1,206 @@
+#include <ledger.h>
+#include <sched.h>
+
+// Outcome of a cross-shard transfer, published by the source shard for
+// the destination shard. Indexed by position in ledger_arena, not by
+// ledgerID: after a restore or WAL recovery the arena starts partway
+// through the ledger.
+#define XFER_PENDING 0
+#define XFER_OK 1
+#define XFER_FAILED 2
+
+static BoundedBuffer<Ledger *> **shard_bb;  // one buffer per shard
+static std::atomic<uint8_t> *xfer_outcome;
+static int num_shards;
+static int num_routers;
+
+static inline int shard_of(int accountID) {
+  return (unsigned)accountID % num_shards;
+}
+
+/**
+ * @brief Router thread for EXEC_SHARDED: walks the whole ledger in order and
+ * feeds the shards it is responsible for (shard % num_routers == id).
+ *
+ * @details
+ * Deposits and withdrawals go to the shard owning `acc`. A transfer between
+ * two shards is sent to both: the source shard decides it and debits, the
+ * destination shard waits for that decision and credits. The source copy is
+ * always queued before the destination copy.
+ *
+ * Entries are appended strictly in ledger order. Consecutive entries for the
+ * same shard are batched into one append_n(), but a batch is flushed as soon
+ * as an entry for another shard comes along. That keeps the waiting
+ * destination shards deadlock free: a router can only be blocked on entry
+ * k after everything before k is queued, so every transfer a shard waits on
+ * is already queued at its source, and the chain of waits only ever moves to
+ * smaller ledgerIDs.
+ *
+ * Each router ends by queueing a NULL sentinel to each of its shards.
+ *
+ * @param routerID A pointer to the router's index.
+ * @return NULL.
+ */
+static void *shard_producer(void *routerID) {
+  int id = *((int *)routerID);
+  Ledger **run = new Ledger *[opts.batch];
+  int run_len = 0, run_shard = -1;
+
+  auto queue = [&](int s, Ledger *entry) {
+    if (s % num_routers != id) return;
+    if (run_len == opts.batch || (run_len > 0 && s != run_shard)) {
+      shard_bb[run_shard]->append_n(run, run_len);
+      run_len = 0;
+    }
+    run_shard = s;
+    run[run_len++] = entry;
+  };
+
+  for (int i = 0; i < max_items; i++) {
+    Ledger *entry = &ledger_arena[i];
+    int src = shard_of(entry->acc);
+    queue(src, entry);
+    if (entry->mode == T && shard_of(entry->other) != src) {
+      queue(shard_of(entry->other), entry);
+    }
+  }
+  if (run_len > 0) {
+    shard_bb[run_shard]->append_n(run, run_len);
+  }
+
+  for (int s = id; s < num_shards; s += num_routers) {
+    shard_bb[s]->append(NULL);
+  }
+  delete[] run;
+  return NULL;
+}
+
+/**
+ * @brief Applies one entry on the shard that owns its account(s).
+ *
+ * Every account touched here belongs to shard `s`, so no account lock is
+ * taken; only the destination half of a cross-shard transfer synchronizes,
+ * by waiting for the source shard's published outcome.
+ */
+static void apply_on_shard(int s, Ledger *entry) {
+  if (entry->mode == D) {
+    bank->depositLocal(s, entry->ledgerID, entry->acc, entry->amount);
+  } else if (entry->mode == W) {
+    bank->withdrawLocal(s, entry->ledgerID, entry->acc, entry->amount);
+  } else if (entry->mode == T) {
+    int src = shard_of(entry->acc), dest = shard_of(entry->other);
+    if (src == dest) {
+      bank->transferLocal(s, entry->ledgerID, entry->acc, entry->other,
+                          entry->amount);
+    } else if (s == src) {
+      int r = bank->transferOut(s, entry->ledgerID, entry->acc, entry->other,
+                                entry->amount);
+      xfer_outcome[entry - ledger_arena.data()].store(
+          r == 0 ? XFER_OK : XFER_FAILED, std::memory_order_release);
+    } else {
+      uint8_t outcome;
+      while ((outcome = xfer_outcome[entry - ledger_arena.data()].load(
+                  std::memory_order_acquire)) == XFER_PENDING) {
+        sched_yield();
+      }
+      if (outcome == XFER_OK) {
+        bank->transferIn(entry->other, entry->amount);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Consumer thread for EXEC_SHARDED: drains its own shard's buffer
+ * until the router's sentinel arrives.
+ *
+ * @param shardID A pointer to the shard index, also used as the worker ID.
+ * @return NULL.
+ */
+static void *shard_consumer(void *shardID) {
+  int s = *((int *)shardID);
+  Ledger **batch = new Ledger *[opts.batch];
+
+  bool done = false;
+  while (!done) {
+    int n = shard_bb[s]->remove_up_to(batch, opts.batch);
+    for (int i = 0; i < n; i++) {
+      if (batch[i] == NULL) {
+        done = true;
+        break;
+      }
+      apply_on_shard(s, batch[i]);
+    }
+    bank->syncWal();
+  }
+
+  delete[] batch;
+  return NULL;
+}
+
+/**
+ * @brief Runs the loaded ledger in account-partitioned (EXEC_SHARDED) mode.
+ *
+ * @details
+ * Consumer s owns every account with `acc % c == s` and has a bounded
+ * buffer of its own. min(p, c) routers split the shards between them and
+ * each walks the ledger in order, so every shard sees its entries in
+ * ledgerID order. Deposits and withdrawals run without any lock on
+ * shard-local accounts; cross-shard transfers use a two-phase handoff (see
+ * shard_producer()).
+ *
+ * Because each shard applies its entries in ledger order and a
+ * destination shard waits for each incoming transfer's outcome at that
+ * transfer's position, every account sees the same sequence of operations
+ * as in a serial run: final balances and success/failure counts do not
+ * depend on thread timing.
+ *
+ * @param p The number of producer (router) threads.
+ * @param c The number of consumer threads, i.e. shards.
+ * @param size The size of each shard's bounded buffer.
+ */
+void run_sharded(int p, int c, int size) {
+  num_shards = c;
+  num_routers = min(p, c);
+  shard_bb = new BoundedBuffer<Ledger *> *[c];
+  for (int s = 0; s < c; s++) {
+    shard_bb[s] = new BoundedBuffer<Ledger *>(size, opts.bb_mode);
+  }
+  xfer_outcome = new std::atomic<uint8_t>[max_items];
+  for (int i = 0; i < max_items; i++) {
+    xfer_outcome[i].store(XFER_PENDING, std::memory_order_relaxed);
+  }
+
+  pthread_t *routers = new pthread_t[num_routers];
+  pthread_t *consumers = new pthread_t[c];
+  int *routerIDs = new int[num_routers];
+  int *shardIDs = new int[c];
+
+  for (int i = 0; i < num_routers; i++) {
+    routerIDs[i] = i;
+    int check = pthread_create(&routers[i], NULL, shard_producer, &routerIDs[i]);
+    assert(check == 0);
+  }
+  for (int s = 0; s < c; s++) {
+    shardIDs[s] = s;
+    int check = pthread_create(&consumers[s], NULL, shard_consumer, &shardIDs[s]);
+    assert(check == 0);
+  }
+
+  for (int i = 0; i < num_routers; i++) {
+    pthread_join(routers[i], NULL);
+  }
+  for (int s = 0; s < c; s++) {
+    pthread_join(consumers[s], NULL);
+  }
+
+  for (int s = 0; s < c; s++) {
+    delete shard_bb[s];
+  }
+  delete[] shard_bb;
+  delete[] xfer_outcome;
+  delete[] routers;
+  delete[] consumers;
+  delete[] routerIDs;
+  delete[] shardIDs;
+}
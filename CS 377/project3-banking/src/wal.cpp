@@ -0,0 +1,278 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <wal.h>
+
+static std::atomic<uint64_t> next_wal_id{1};
+
+// The number of the last record the calling thread appended, and to which
+// log (ids are never reused, as with LogSink).
+struct LocalLsn {
+  uint64_t wal_id;
+  uint64_t lsn;
+};
+static thread_local LocalLsn local_lsn = {0, 0};
+
+/**
+ * @brief FNV-1a over a record's fields, with `check` itself left out.
+ */
+uint32_t wal_checksum(const WalRecord &r) {
+  const unsigned char *p = (const unsigned char *)&r;
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < offsetof(WalRecord, check); i++) {
+    h = (h ^ p[i]) * 16777619u;
+  }
+  return h;
+}
+
+// Writes all of `data`; false (with errno set) if the file will not take it.
+static bool write_all(int fd, const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, data, len);
+    if (n == 0) errno = EIO;
+    if (n <= 0) return false;
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+/**
+ * @brief Reads every intact record of a WAL file.
+ *
+ * Reading stops at the first short record or checksum mismatch, which is
+ * where a crash cut the log off; the file is truncated there so that new
+ * records are appended after the last good one. A missing or empty file is
+ * an empty log.
+ *
+ * @return The number of records read, or -1 if the file is not a WAL.
+ */
+int read_wal(const char *filename, vector<WalRecord> &out) {
+  out.clear();
+  int fd = open(filename, O_RDWR);
+  if (fd < 0) return 0;
+
+  struct stat st;
+  char header[8];
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+  if (read(fd, header, 8) != 8 || memcmp(header, WAL_MAGIC, 4) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  size_t n = (st.st_size - 8) / sizeof(WalRecord);
+  out.resize(n);
+  ssize_t got = read(fd, out.data(), n * sizeof(WalRecord));
+  n = got < 0 ? 0 : got / sizeof(WalRecord);
+  size_t good = 0;
+  while (good < n && out[good].check == wal_checksum(out[good])) good++;
+  out.resize(good);
+
+  off_t end = 8 + good * sizeof(WalRecord);
+  if (end != st.st_size && ftruncate(fd, end) < 0) {
+    close(fd);
+    return -1;
+  }
+  close(fd);
+  return good;
+}
+
+/**
+ * @brief Opens (or creates) the log for appending and starts the flusher.
+ *
+ * Check ok() afterwards: it is false if the file could not be opened.
+ *
+ * @param level WAL_ASYNC, WAL_GROUP or WAL_SYNC.
+ * @param interval_us The longest a record waits in a group before the
+ * flusher writes it.
+ */
+WriteAheadLog::WriteAheadLog(const char *filename, int level, int interval_us)
+    : level(level), interval_us(interval_us) {
+  id = next_wal_id.fetch_add(1);
+  appended = synced = 0;
+  error = 0;
+  waiters = 0;
+  stop = false;
+  groups = 0;
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&work, NULL);
+  pthread_cond_init(&durable, NULL);
+  active.reserve(WAL_GROUP_BYTES);
+  flushing.reserve(WAL_GROUP_BYTES);
+
+  fd = open(filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (fd < 0) return;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size == 0) {
+    char header[8] = {0};
+    uint32_t version = WAL_VERSION;
+    memcpy(header, WAL_MAGIC, 4);
+    memcpy(header + 4, &version, 4);
+    if (!write_all(fd, header, 8)) {
+      close(fd);
+      fd = -1;
+      return;
+    }
+  }
+
+  int check = pthread_create(&thread, NULL, flusher, this);
+  assert(check == 0);
+}
+
+WriteAheadLog::~WriteAheadLog() {
+  if (fd >= 0) {
+    pthread_mutex_lock(&lock);
+    stop = true;
+    pthread_cond_signal(&work);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, NULL);
+    close(fd);
+  }
+  pthread_mutex_destroy(&lock);
+  pthread_cond_destroy(&work);
+  pthread_cond_destroy(&durable);
+}
+
+/**
+ * @brief Adds a record to the current group.
+ *
+ * Only a memcpy happens under the log's mutex; the write and fsync are
+ * left to the flusher, so this is cheap enough to call with account locks
+ * held.
+ */
+void WriteAheadLog::append(const WalRecord &r) {
+  WalRecord rec = r;
+  rec.pad = 0;
+  rec.check = wal_checksum(rec);
+
+  pthread_mutex_lock(&lock);
+  active.insert(active.end(), (const char *)&rec,
+                (const char *)&rec + sizeof(rec));
+  local_lsn = {id, ++appended};
+  if (active.size() == sizeof(rec) || active.size() >= WAL_GROUP_BYTES) {
+    pthread_cond_signal(&work);  // a group started, or is full
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+/**
+ * @brief With WAL_SYNC, returns once every record the calling thread
+ * appended is on disk. At the other levels it does not wait.
+ *
+ * Call it after releasing account locks, e.g. once per consumer batch.
+ *
+ * @return 0, or the errno of a failed write or fsync of the log.
+ */
+int WriteAheadLog::sync() {
+  if (level != WAL_SYNC || local_lsn.wal_id != id) return getError();
+  return waitFor(local_lsn.lsn);
+}
+
+/**
+ * @brief With WAL_SYNC, returns once everything appended so far, by any
+ * thread, is durable. At the other levels it does not wait.
+ *
+ * @return 0, or the errno of a failed write or fsync of the log.
+ */
+int WriteAheadLog::syncAll() {
+  if (level != WAL_SYNC) return getError();
+  return flush();
+}
+
+/**
+ * @brief Returns once everything appended so far, by any thread, has been
+ * written (and synced, unless WAL_ASYNC).
+ *
+ * @return 0, or the errno of a failed write or fsync of the log.
+ */
+int WriteAheadLog::flush() {
+  pthread_mutex_lock(&lock);
+  uint64_t lsn = appended;
+  pthread_mutex_unlock(&lock);
+  return waitFor(lsn);
+}
+
+// Cuts the current group early and waits for record `lsn` to be written,
+// or for the log to fail. Returns the log's error.
+int WriteAheadLog::waitFor(uint64_t lsn) {
+  pthread_mutex_lock(&lock);
+  if (synced < lsn && error == 0) {
+    waiters++;
+    pthread_cond_signal(&work);
+    while (synced < lsn && error == 0) pthread_cond_wait(&durable, &lock);
+    waiters--;
+  }
+  int err = error;
+  pthread_mutex_unlock(&lock);
+  return err;
+}
+
+/**
+ * @brief Flusher thread: writes out one group at a time.
+ *
+ * The flusher sleeps while there is nothing to write. Once a group starts,
+ * it is cut when the interval expires, when it reaches WAL_GROUP_BYTES, or
+ * right away when a sync() or flush() caller is waiting.
+ * Everything appended while the previous group was being written and
+ * synced goes into the next one, which is where concurrent callers'
+ * records get coalesced. After a failure, groups are dropped unwritten:
+ * the file ends at the failed group, and `synced` stays before it.
+ */
+void *WriteAheadLog::flusher(void *arg) {
+  WriteAheadLog *wal = (WriteAheadLog *)arg;
+  pthread_mutex_lock(&wal->lock);
+  while (true) {
+    if (wal->active.empty()) {
+      if (wal->stop) break;
+      pthread_cond_wait(&wal->work, &wal->lock);  // until a group starts
+      continue;
+    }
+    // let the group fill for one interval, unless someone needs it now
+    if (wal->waiters == 0 && !wal->stop &&
+        wal->active.size() < WAL_GROUP_BYTES) {
+      struct timespec until;
+      clock_gettime(CLOCK_REALTIME, &until);
+      long ns = until.tv_nsec + (long)wal->interval_us * 1000;
+      until.tv_sec += ns / 1000000000L;
+      until.tv_nsec = ns % 1000000000L;
+      pthread_cond_timedwait(&wal->work, &wal->lock, &until);
+    }
+
+    wal->active.swap(wal->flushing);
+    uint64_t upto = wal->appended;
+    pthread_mutex_unlock(&wal->lock);
+
+    int err = wal->getError();
+    if (err == 0) {
+      bool ok =
+          write_all(wal->fd, wal->flushing.data(), wal->flushing.size());
+      if (ok && wal->level != WAL_ASYNC) ok = fdatasync(wal->fd) == 0;
+      if (!ok) err = errno;
+    }
+    wal->flushing.clear();
+
+    pthread_mutex_lock(&wal->lock);
+    if (err == 0) {
+      wal->synced = upto;
+      wal->groups++;
+    } else {
+      wal->error = err;
+    }
+    pthread_cond_broadcast(&wal->durable);
+  }
+  pthread_mutex_unlock(&wal->lock);
+  return NULL;
+}
@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <signal.h>
+#include <sys/resource.h>
 #include <time.h>
 #include <atomic>
 #include <cerrno>
@@ -17,7 +19,10 @@
 #include <thread>
 #include <vector>
 
+#include "checkpoint.h"
 #include "ledger.h"
+#include "ledgerFile.h"
+#include "wal.h"
 
 using namespace std;
 
@@ -72,6 +77,663 @@ TEST(BankTest, TestLogs) {
   EXPECT_EQ(i, 5) << "There should be 5 lines in the log";
 }
 
+// the async sink must produce byte-identical log lines
+TEST(BankTest, TestAsyncLogs) {
+  string logs[5]{"[ SUCCESS ] TID: 0, LID: 0, Acc: 1 DEPOSIT $100",
+                 "[ SUCCESS ] TID: 0, LID: 1, Acc: 1 WITHDRAW $50",
+                 "[ SUCCESS ] TID: 0, LID: 2, Acc: 1 TRANSFER $10 TO Acc: 0",
+                 "[ FAIL ] TID: 0, LID: 3, Acc: 3 WITHDRAW $100",
+                 "[ FAIL ] TID: 0, LID: 4, Acc: 6 TRANSFER $200 TO Acc: 7"};
+
+  int i = 0;
+  stringstream output;
+  streambuf *oldCoutStreamBuf = cout.rdbuf();
+  cout.rdbuf(output.rdbuf());
+
+  bank_t = new Bank(10, BANK_ASYNC_LOG);
+  output.str("");  // drop the constructor's account dump
+
+  bank_t->deposit(0, 0, 1, 100);
+  bank_t->withdraw(0, 1, 1, 50);
+  bank_t->transfer(0, 2, 1, 0, 10);
+  bank_t->withdraw(0, 3, 3, 100);
+  bank_t->transfer(0, 4, 6, 7, 200);
+  bank_t->flushLog();
+
+  EXPECT_EQ(bank_t->getNumSucc(), 3);
+  EXPECT_EQ(bank_t->getNumFail(), 2);
+
+  string line = "";
+  while (getline(output, line) && i < 5) {
+    EXPECT_EQ(line, logs[i++]) << "Async log msg did not match";
+  }
+  EXPECT_EQ(i, 5) << "There should be 5 lines in the log";
+
+  delete bank_t;
+  cout.rdbuf(oldCoutStreamBuf);
+}
+
+// outcomes counted by many workers must add up across the counter shards
+TEST(BankTest, TestShardedCounters) {
+  bank_t = new Bank(10, BANK_QUIET);
+  vector<thread> workers;
+  for (int w = 0; w < 8; w++) {
+    workers.emplace_back([w] {
+      for (int k = 0; k < 1000; k++) {
+        bank_t->deposit(w, k, k % 10, 1);
+        bank_t->withdraw(w, k, k % 10, 1000000);
+      }
+    });
+  }
+  for (auto &t : workers) t.join();
+
+  EXPECT_EQ(bank_t->getNumSucc(), 8000);
+  EXPECT_EQ(bank_t->getNumFail(), 8000);
+  delete bank_t;
+}
+
+// every account layout must behave the same
+TEST(BankTest, TestLayouts) {
+  for (int layout : {0, BANK_PADDED, BANK_SOA}) {
+    bank_t = new Bank(10, BANK_QUIET | layout);
+    EXPECT_EQ(bank_t->deposit(0, 0, 3, 100), 0);
+    EXPECT_EQ(bank_t->transfer(0, 1, 3, 4, 60), 0);
+    EXPECT_EQ(bank_t->withdraw(0, 2, 3, 50), -1);
+    EXPECT_EQ(bank_t->balanceOf(3).load(), 40);
+    EXPECT_EQ(bank_t->balanceOf(4).load(), 60);
+    EXPECT_EQ(bank_t->totalBalance(), 100);
+    if (layout == BANK_PADDED) {
+      EXPECT_EQ(((uintptr_t)&bank_t->balanceOf(4) / CACHE_LINE) -
+                    ((uintptr_t)&bank_t->balanceOf(3) / CACHE_LINE),
+                1u);
+    }
+    delete bank_t;
+  }
+}
+
+// BANK_ATOMIC keeps the success/fail semantics of TestLogs
+TEST(BankTest, TestAtomicBalances) {
+  bank_t = new Bank(10, BANK_QUIET | BANK_ATOMIC);
+
+  EXPECT_EQ(bank_t->deposit(0, 0, 1, 100), 0);
+  EXPECT_EQ(bank_t->withdraw(0, 1, 1, 50), 0);
+  EXPECT_EQ(bank_t->transfer(0, 2, 1, 0, 10), 0);
+  EXPECT_EQ(bank_t->withdraw(0, 3, 3, 100), -1);
+  EXPECT_EQ(bank_t->transfer(0, 4, 6, 7, 200), -1);
+  EXPECT_EQ(bank_t->transfer(0, 5, 1, 1, 1), -1);
+  EXPECT_EQ(bank_t->getNumSucc(), 3);
+  EXPECT_EQ(bank_t->getNumFail(), 3);
+  EXPECT_EQ(bank_t->balanceOf(0).load(), 10);
+  EXPECT_EQ(bank_t->balanceOf(1).load(), 40);
+  delete bank_t;
+
+  // racing withdrawals and transfers may never overdraw an account
+  bank_t = new Bank(4, BANK_QUIET | BANK_ATOMIC);
+  for (int a = 0; a < 4; a++) bank_t->deposit(0, 0, a, 1000);
+  vector<thread> workers;
+  for (int w = 0; w < 4; w++) {
+    workers.emplace_back([w] {
+      for (int k = 0; k < 2000; k++) {
+        bank_t->withdraw(w, k, k % 4, 3);
+        bank_t->transfer(w, k, k % 4, (k + w + 1) % 4, 5);
+      }
+    });
+  }
+  for (auto &t : workers) t.join();
+
+  long total = 0;
+  for (int a = 0; a < 4; a++) {
+    EXPECT_GE(bank_t->balanceOf(a).load(), 0);
+    total += bank_t->balanceOf(a).load();
+  }
+  EXPECT_EQ(total, bank_t->totalBalance());
+  // every successful withdrawal took exactly 3 out of the bank
+  int withdrawn = (4000 - total) / 3;
+  EXPECT_EQ((4000 - total) % 3, 0);
+  EXPECT_LE(withdrawn, bank_t->getNumSucc());
+  delete bank_t;
+}
+
+TEST(BankTest, TestLockStats) {
+  lock_stats_reset();
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  for (int i = 0; i < 5; i++) {
+    stat_lock(&lock, LOCK_CLASS_ACCOUNT, 7);
+    stat_unlock(&lock, LOCK_CLASS_ACCOUNT, 7);
+  }
+  EXPECT_EQ(lock_stats_class(LOCK_CLASS_ACCOUNT).acquired, 5);
+  EXPECT_EQ(lock_stats_class(LOCK_CLASS_ACCOUNT).contended, 0);
+  EXPECT_EQ(lock_stats_account(7).acquired, 5);
+  EXPECT_EQ(lock_stats_account(6).acquired, 0);
+
+  // a lock held by someone else is contended, and its wait is timed
+  stat_lock(&lock, LOCK_CLASS_LEDGER, -1);
+  thread waiter([&lock] {
+    stat_lock(&lock, LOCK_CLASS_LEDGER, -1);
+    stat_unlock(&lock, LOCK_CLASS_LEDGER, -1);
+  });
+  this_thread::sleep_for(chrono::milliseconds(20));
+  stat_unlock(&lock, LOCK_CLASS_LEDGER, -1);
+  waiter.join();
+
+  LockStat s = lock_stats_class(LOCK_CLASS_LEDGER);
+  EXPECT_EQ(s.acquired, 2);
+  EXPECT_EQ(s.contended, 1);
+  EXPECT_GE(s.max_wait_ns, 10 * 1000000L);
+  EXPECT_GE(s.hold_ns, 10 * 1000000L);
+  EXPECT_EQ(s.wait_ns, s.max_wait_ns);
+
+  stringstream out;
+  lock_stats_report(out);
+  EXPECT_NE(out.str().find("acc 7"), string::npos);
+  EXPECT_EQ(out.str().find("acc 6"), string::npos);
+  lock_stats_reset();
+}
+
+TEST(BankTest, TestLazyStripedAccounts) {
+  const int n = 10 * 1000 * 1000;
+  bank_t = new Bank(n, BANK_QUIET | BANK_LAZY, 16);
+  EXPECT_FALSE(bank_t->exists(0));
+  EXPECT_EQ(bank_t->totalBalance(), 0);
+
+  EXPECT_EQ(bank_t->deposit(0, 0, n - 1, 100), 0);
+  EXPECT_EQ(bank_t->deposit(0, 1, 5, 50), 0);
+  EXPECT_TRUE(bank_t->exists(n - 1));
+  EXPECT_TRUE(bank_t->exists(5));
+  EXPECT_FALSE(bank_t->exists(n / 2));
+
+  // 21 % 16 == 5 % 16: both accounts share one stripe
+  EXPECT_EQ(bank_t->lockOf(5), bank_t->lockOf(21));
+  EXPECT_EQ(bank_t->transfer(0, 2, 5, 21, 30), 0);
+  EXPECT_EQ(bank_t->transfer(0, 3, n - 1, 17, 60), 0);
+  EXPECT_EQ(bank_t->transfer(0, 4, 17, n - 1, 61), -1);
+  EXPECT_EQ(bank_t->balanceOf(5).load(), 20);
+  EXPECT_EQ(bank_t->balanceOf(21).load(), 30);
+  EXPECT_EQ(bank_t->balanceOf(17).load(), 60);
+  EXPECT_EQ(bank_t->balanceOf(n - 1).load(), 40);
+  EXPECT_EQ(bank_t->totalBalance(), 150);
+  delete bank_t;
+
+  // threads racing to touch the same fresh page all see one copy of it
+  bank_t = new Bank(n, BANK_QUIET | BANK_LAZY | BANK_ATOMIC);
+  vector<thread> workers;
+  for (int w = 0; w < 8; w++) {
+    workers.emplace_back([w] {
+      for (int k = 0; k < 1000; k++) bank_t->deposit(w, k, 3 * ACCOUNT_PAGE + k % 7, 1);
+    });
+  }
+  for (auto &t : workers) t.join();
+  EXPECT_EQ(bank_t->totalBalance(), 8000);
+  delete bank_t;
+}
+
+// reference: what the original fscanf loop produced
+static vector<Ledger> scanf_ledger(const string &text) {
+  vector<Ledger> rows;
+  FILE *f = fmemopen((void *)text.data(), text.size(), "r");
+  int acc, other, amount, mode;
+  while (fscanf(f, "%d %d %d %d", &acc, &other, &amount, &mode) == 4) {
+    rows.push_back(Ledger{acc, other, amount, mode, (int)rows.size()});
+  }
+  fclose(f);
+  return rows;
+}
+
+static void expect_same(const vector<Ledger> &a, const vector<Ledger> &b) {
+  ASSERT_EQ(a.size(), b.size());
+  for (size_t i = 0; i < a.size(); i++) {
+    EXPECT_EQ(a[i].acc, b[i].acc);
+    EXPECT_EQ(a[i].other, b[i].other);
+    EXPECT_EQ(a[i].amount, b[i].amount);
+    EXPECT_EQ(a[i].mode, b[i].mode);
+    EXPECT_EQ(a[i].ledgerID, b[i].ledgerID);
+  }
+}
+
+// the parallel parser must agree with fscanf, including where it stops
+TEST(LedgerTest, TestParseLedgerText) {
+  vector<string> inputs = {"8 0 38 0\n8 9 237 2\r\n  1 6 -9 0\n\n3 4 95 1",
+                           "1 2 3 0\n4 5 6 1\nx 1 1 1\n7 8 9 2\n",
+                           "1 2 3 0\n4 5\n", ""};
+  string big;
+  for (int i = 0; i < 300000; i++) {
+    big += to_string(i % 10) + " " + to_string(i % 7) + " " +
+           to_string(i) + " " + to_string(i % 3) + "\n";
+  }
+  inputs.push_back(big);
+  inputs.push_back(big + "oops\n" + big);
+
+  for (const string &text : inputs) {
+    for (int threads : {1, 4}) {
+      vector<Ledger> rows;
+      int n = parse_ledger_text(text.data(), text.size(), rows, threads);
+      EXPECT_EQ(n, (int)rows.size());
+      expect_same(rows, scanf_ledger(text));
+    }
+  }
+}
+
+// text -> binary -> rows must round-trip, with and without delta encoding
+TEST(LedgerTest, TestBinaryLedger) {
+  vector<Ledger> rows;
+  for (int i = 0; i < 1000; i++) {
+    rows.push_back(Ledger{1000 + i % 50, 1000 + (i * 7) % 50, i * 3 - 500,
+                          i % 3, i});
+  }
+  rows.push_back(Ledger{-5, 70000, 1, T, 1000});
+  // `other` is unused for deposits: stored, but not an account touched
+  rows.push_back(Ledger{1000, -90000, 1, D, 1001});
+
+  for (bool delta : {false, true}) {
+    char path[] = "/tmp/ledger_binXXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+
+    ASSERT_EQ(write_ledger_binary(path, rows, delta), 0);
+    vector<Ledger> back;
+    LedgerFileHeader h;
+    EXPECT_EQ(read_ledger_file(path, back, 1, &h), (int)rows.size());
+    EXPECT_EQ(h.count, rows.size());
+    EXPECT_EQ(h.min_acc, -5);
+    EXPECT_EQ(h.max_acc, 70000);
+    expect_same(back, rows);
+
+    // a truncated file is rejected rather than read past its end
+    ASSERT_EQ(truncate(path, sizeof(LedgerFileHeader) + 16), 0);
+    EXPECT_EQ(read_ledger_file(path, back, 1), -1);
+    unlink(path);
+  }
+
+  // narrow IDs: deltas of +-1 fit a byte even though offsets need two
+  vector<Ledger> walk;
+  for (int i = 0; i < 600; i++) walk.push_back(Ledger{i, i, 1, D, i});
+  char path[] = "/tmp/ledger_binXXXXXX";
+  close(mkstemp(path));
+  ASSERT_EQ(write_ledger_binary(path, walk, true), 0);
+  vector<Ledger> back;
+  LedgerFileHeader h;
+  read_ledger_file(path, back, 1, &h);
+  EXPECT_EQ(h.flags, LEDGER_DELTA);
+  EXPECT_EQ(h.id_bytes, 1);
+  expect_same(back, walk);
+  unlink(path);
+}
+
+// producers that start with nothing must steal, and every entry must be
+// handed out exactly once
+TEST(LedgerTest, TestWorkStealing) {
+  const int n = 10000, p = 4;
+  ledger_arena.clear();
+  for (int i = 0; i < n; i++) ledger_arena.push_back(Ledger{0, 0, 1, D, i});
+
+  num_ranges = p;
+  ranges = new LedgerRange[p];
+  ranges[0].span = pack_range(0, n);  // everything starts with producer 0
+  for (int i = 1; i < p; i++) ranges[i].span = pack_range(n, n);
+
+  bb = new BoundedBuffer<Ledger *>(n);
+  int ids[p];
+  pthread_t tids[p];
+  for (int i = 0; i < p; i++) {
+    ids[i] = i;
+    pthread_create(&tids[i], NULL, producer, &ids[i]);
+  }
+  for (int i = 0; i < p; i++) pthread_join(tids[i], NULL);
+
+  vector<int> seen(n, 0);
+  while (!bb->isEmpty()) seen[bb->remove()->ledgerID]++;
+  for (int i = 0; i < n; i++) EXPECT_EQ(seen[i], 1) << "entry " << i;
+
+  delete bb;
+  delete[] ranges;
+  ledger_arena.clear();
+}
+
+// random D/W/T mix over `accounts` accounts, with plenty of failures
+static void random_ledger(int n, int accounts, unsigned seed) {
+  srand(seed);
+  ledger_arena.clear();
+  for (int i = 0; i < n; i++) {
+    ledger_arena.push_back(Ledger{rand() % accounts, rand() % accounts,
+                                  rand() % 100, rand() % 3, i});
+  }
+}
+
+// applies ledger_arena one entry at a time, in order, on a fresh bank
+static Bank *serial_bank(int accounts) {
+  Bank *ref = new Bank(accounts, BANK_QUIET);
+  for (Ledger &e : ledger_arena) {
+    if (e.mode == D) ref->deposit(0, e.ledgerID, e.acc, e.amount);
+    if (e.mode == W) ref->withdraw(0, e.ledgerID, e.acc, e.amount);
+    if (e.mode == T) ref->transfer(0, e.ledgerID, e.acc, e.other, e.amount);
+  }
+  return ref;
+}
+
+static void expect_same_bank(Bank *a, Bank *b, int accounts) {
+  for (int i = 0; i < accounts; i++) {
+    EXPECT_EQ(a->balanceOf(i).load(), b->balanceOf(i).load()) << "account " << i;
+  }
+  EXPECT_EQ(a->getNumSucc(), b->getNumSucc());
+  EXPECT_EQ(a->getNumFail(), b->getNumFail());
+}
+
+TEST(LedgerTest, TestSharded) {
+  const int n = 20000, accounts = 10;
+  random_ledger(n, accounts, 377);
+  Bank *ref = serial_bank(accounts);
+  max_items = n;
+
+  // shards >= routers, shards < routers, and a buffer of one
+  int shapes[][3] = {{1, 1, 4}, {2, 3, 8}, {5, 2, 1}, {3, 4, 64}};
+  for (auto &shape : shapes) {
+    bank = new Bank(accounts, BANK_QUIET);
+    run_sharded(shape[0], shape[1], shape[2]);
+    expect_same_bank(bank, ref, accounts);
+    delete bank;
+  }
+
+  delete ref;
+  ledger_arena.clear();
+}
+
+TEST(LedgerTest, TestDeterministic) {
+  // spans several windows, with a partial last one
+  const int n = 2 * DET_WINDOW + 123, accounts = 10;
+  random_ledger(n, accounts, 2024);
+  Bank *ref = serial_bank(accounts);
+  max_items = n;
+
+  for (int c : {1, 3, 8}) {
+    for (int mode : {BB_MUTEX, BB_LOCKFREE}) {
+      opts.bb_mode = mode;
+      bank = new Bank(accounts, BANK_QUIET);
+      run_deterministic(1, c, 0);
+      expect_same_bank(bank, ref, accounts);
+      delete bank;
+    }
+  }
+  opts.bb_mode = BB_MUTEX;
+
+  delete ref;
+  ledger_arena.clear();
+}
+
+TEST(LedgerTest, TestGroupCommit) {
+  const int n = 20000, accounts = 10;
+  random_ledger(n, accounts, 12);
+  Bank *ref = serial_bank(accounts);
+  max_items = n;
+  opts.group_commit = 1;
+  opts.batch = 64;
+
+  // one producer and one consumer: grouping must not change the result
+  bank = new Bank(accounts, BANK_QUIET);
+  con_items = 0;
+  run_shared(1, 1, 128);
+  expect_same_bank(bank, ref, accounts);
+  delete bank;
+
+  // many consumers: every entry counted once, no money created or lost
+  bank = new Bank(accounts, BANK_QUIET);
+  con_items = 0;
+  run_shared(3, 4, 16);
+  EXPECT_EQ(bank->getNumSucc() + bank->getNumFail(), n);
+  long total = 0;
+  for (int i = 0; i < accounts; i++) {
+    EXPECT_GE(bank->balanceOf(i).load(), 0);
+    total += bank->balanceOf(i).load();
+  }
+  EXPECT_EQ(total, bank->totalBalance());
+  delete bank;
+
+  opts.group_commit = 0;
+  opts.batch = 32;
+  delete ref;
+  ledger_arena.clear();
+}
+
+TEST(LedgerTest, TestCheckpointRestore) {
+  const int n = 3 * DET_WINDOW + 77, accounts = 10;
+  const char *file = "checkpoint_test.snap";
+  random_ledger(n, accounts, 99);
+  Bank *ref = serial_bank(accounts);
+  vector<Ledger> full = ledger_arena;
+
+  // run a prefix that stops mid-ledger, checkpointing every window
+  opts.checkpoint_file = file;
+  opts.checkpoint_every = 1;
+  ledger_arena.resize(2 * DET_WINDOW + 10);
+  max_items = ledger_arena.size();
+  bank = new Bank(accounts, BANK_QUIET);
+  run_deterministic(1, 3, 0);
+  delete bank;
+  opts.checkpoint_file = NULL;
+
+  Snapshot snap;
+  ASSERT_EQ(read_snapshot(file, snap), 0);
+  EXPECT_EQ(snap.last_ledger, 2 * DET_WINDOW + 9);
+  EXPECT_EQ(snap.accounts, accounts);
+  EXPECT_EQ(snap.succ + snap.fail, 2 * DET_WINDOW + 10);
+  for (auto &b : snap.balances) EXPECT_NE(b.second, 0);
+
+  // restore into a fresh bank and finish the ledger
+  ledger_arena = full;
+  bank = new Bank(accounts, BANK_QUIET);
+  ASSERT_EQ(apply_snapshot(bank, snap), 0);
+  skip_applied(snap.last_ledger);
+  EXPECT_EQ(ledger_arena.front().ledgerID, 2 * DET_WINDOW + 10);
+  max_items = ledger_arena.size();
+  run_deterministic(1, 2, 0);
+  expect_same_bank(bank, ref, accounts);
+  delete bank;
+
+  // the same in sharded mode, whose arena no longer starts at ledgerID 0
+  ledger_arena = full;
+  bank = new Bank(accounts, BANK_QUIET);
+  ASSERT_EQ(apply_snapshot(bank, snap), 0);
+  skip_applied(snap.last_ledger);
+  max_items = ledger_arena.size();
+  run_sharded(2, 3, 8);
+  expect_same_bank(bank, ref, accounts);
+  delete bank;
+
+  // a snapshot that names accounts the bank lacks is refused
+  Bank *small = new Bank(2, BANK_QUIET);
+  snap.balances.push_back({9, 1});
+  EXPECT_EQ(apply_snapshot(small, snap), -1);
+  delete small;
+
+  // a corrupt count, or a file cut short, is refused without sizing
+  // anything by the count
+  ASSERT_EQ(write_snapshot(file, snap), 0);
+  {
+    fstream f(file, ios::in | ios::out | ios::binary);
+    uint64_t huge = 1ull << 60;
+    f.seekp(offsetof(SnapshotHeader, count));
+    f.write((const char *)&huge, sizeof(huge));
+  }
+  EXPECT_EQ(read_snapshot(file, snap), -1);
+  ASSERT_EQ(write_snapshot(file, snap), 0);
+  truncate(file, sizeof(SnapshotHeader) + 8);
+  EXPECT_EQ(read_snapshot(file, snap), -1);
+
+  remove(file);
+  EXPECT_EQ(read_snapshot(file, snap), -1);
+  delete ref;
+  ledger_arena.clear();
+}
+
+TEST(LedgerTest, TestWriteAheadLog) {
+  const int n = 5000, accounts = 10;
+  const char *file = "wal_test.wal";
+  remove(file);
+  random_ledger(n, accounts, 7);
+  Bank *ref = serial_bank(accounts);
+  vector<Ledger> full = ledger_arena;
+  opts.wal_file = file;
+  opts.wal_level = WAL_SYNC;
+
+  // first run dies after applying only part of the ledger; one producer
+  // and one consumer log it in ledger order, so any cut is a prefix
+  ledger_arena.resize(n / 2);
+  max_items = ledger_arena.size();
+  con_items = 0;
+  bank = new Bank(accounts, BANK_QUIET);
+  WriteAheadLog *wal = recover_wal(-1);
+  ASSERT_NE(wal, (WriteAheadLog *)NULL);
+  run_shared(1, 1, 16);
+  delete wal;
+  delete bank;
+
+  vector<WalRecord> log;
+  ASSERT_EQ(read_wal(file, log), n / 2);
+
+  // tear the last record, as a crash mid-write would
+  truncate(file, 8 + (n / 2) * sizeof(WalRecord) - 5);
+  ASSERT_EQ(read_wal(file, log), n / 2 - 1);
+  EXPECT_EQ(log.back().check, wal_checksum(log.back()));
+  const char *torn = "wal_test_torn.wal";
+  {
+    ifstream in(file, ios::binary);
+    ofstream out(torn, ios::binary);
+    out << in.rdbuf();
+  }
+
+  // the rerun replays the log, skips what it covers and finishes the rest
+  ledger_arena = full;
+  bank = new Bank(accounts, BANK_QUIET);
+  wal = recover_wal(-1);
+  ASSERT_NE(wal, (WriteAheadLog *)NULL);
+  EXPECT_EQ((int)ledger_arena.size(), n - (n / 2 - 1));
+  max_items = ledger_arena.size();
+  run_deterministic(1, 2, 0);
+  delete wal;
+  expect_same_bank(bank, ref, accounts);
+  delete bank;
+  EXPECT_EQ(read_wal(file, log), n);
+
+  // recovering the torn log in sharded mode, too
+  rename(torn, file);
+  ledger_arena = full;
+  bank = new Bank(accounts, BANK_QUIET);
+  wal = recover_wal(-1);
+  ASSERT_NE(wal, (WriteAheadLog *)NULL);
+  max_items = ledger_arena.size();
+  run_sharded(3, 2, 16);
+  delete wal;
+  expect_same_bank(bank, ref, accounts);
+  delete bank;
+  EXPECT_EQ(read_wal(file, log), n);
+
+  // a log-only recovery reproduces the balances with nothing left to run
+  ledger_arena = full;
+  bank = new Bank(accounts, BANK_QUIET);
+  wal = recover_wal(-1);
+  EXPECT_TRUE(ledger_arena.empty());
+  delete wal;
+  expect_same_bank(bank, ref, accounts);
+  delete bank;
+
+  // a log that cannot grow must fail sync() rather than report the records
+  // durable, and stay failed
+  remove(file);
+  wal = new WriteAheadLog(file, WAL_SYNC, 100);
+  ASSERT_TRUE(wal->ok());
+  struct rlimit old_limit, limit;
+  getrlimit(RLIMIT_FSIZE, &old_limit);
+  limit = old_limit;
+  limit.rlim_cur = 8;  // the header only
+  signal(SIGXFSZ, SIG_IGN);
+  setrlimit(RLIMIT_FSIZE, &limit);
+  wal->append(WalRecord{0, 1, 0, 5, TXN_DEPOSIT, 1, 0, 0});
+  EXPECT_EQ(wal->sync(), EFBIG);
+  wal->append(WalRecord{1, 1, 0, 5, TXN_DEPOSIT, 1, 0, 0});
+  EXPECT_EQ(wal->flush(), EFBIG);
+  EXPECT_EQ(wal->getGroups(), 0);
+  setrlimit(RLIMIT_FSIZE, &old_limit);
+  signal(SIGXFSZ, SIG_DFL);
+  delete wal;
+  EXPECT_EQ(read_wal(file, log), 0);
+
+  opts.wal_file = NULL;
+  opts.wal_level = WAL_GROUP;
+  remove(file);
+  delete ref;
+  ledger_arena.clear();
+}
+
+// the stream reader must number and cut entries exactly like the loader,
+// across many refills of its buffer
+TEST(LedgerTest, TestLedgerStream) {
+  random_ledger(3 * LEDGER_STREAM_CHUNK / 8, 1000, 5);
+  char path[] = "/tmp/ledger_streamXXXXXX";
+  close(mkstemp(path));
+  ASSERT_EQ(write_ledger_text(path, ledger_arena), 0);
+  FILE *f = fopen(path, "a");
+  fputs("1 2\n3", f);  // an incomplete record at the end is dropped
+  fclose(f);
+
+  LedgerStream stream(path);
+  ASSERT_TRUE(stream.ok());
+  vector<Ledger> rows;
+  Ledger chunk[37];
+  int n;
+  while ((n = stream.next(chunk, 37)) > 0) {
+    rows.insert(rows.end(), chunk, chunk + n);
+  }
+  expect_same(rows, ledger_arena);
+  EXPECT_EQ(stream.next(chunk, 37), 0);
+
+  // binary ledgers are columnar and cannot be streamed
+  ASSERT_EQ(write_ledger_binary(path, ledger_arena, false), 0);
+  LedgerStream binary(path);
+  EXPECT_FALSE(binary.ok());
+  unlink(path);
+  ledger_arena.clear();
+}
+
+TEST(LedgerTest, TestStreaming) {
+  const int n = 20000, accounts = 10;
+  random_ledger(n, accounts, 21);
+  Bank *ref = serial_bank(accounts);
+  char path[] = "/tmp/ledger_streamXXXXXX";
+  close(mkstemp(path));
+  ASSERT_EQ(write_ledger_text(path, ledger_arena), 0);
+  ledger_arena.clear();
+  opts.batch = 8;
+
+  // one producer and one consumer apply the stream in file order
+  bank = new Bank(accounts, BANK_QUIET);
+  LedgerStream *stream = new LedgerStream(path);
+  run_stream(1, 1, 4, stream);
+  expect_same_bank(bank, ref, accounts);
+  delete stream;
+  delete bank;
+
+  // many of each, grouped, through a tiny buffer: every entry counted
+  // once, no money created or lost
+  opts.group_commit = 1;
+  bank = new Bank(accounts, BANK_QUIET);
+  stream = new LedgerStream(path);
+  run_stream(3, 4, 2, stream);
+  EXPECT_EQ(bank->getNumSucc() + bank->getNumFail(), n);
+  long total = 0;
+  for (int i = 0; i < accounts; i++) {
+    EXPECT_GE(bank->balanceOf(i).load(), 0);
+    total += bank->balanceOf(i).load();
+  }
+  EXPECT_EQ(total, bank->totalBalance());
+  delete stream;
+  delete bank;
+
+  opts.group_commit = 0;
+  opts.batch = 32;
+  unlink(path);
+  delete ref;
+}
+
 TEST(PCTest, Test1) {
   BoundedBuffer<int> *BB = new BoundedBuffer<int>(5);
   EXPECT_TRUE(BB->isEmpty());
@@ -88,6 +750,69 @@ TEST(PCTest, Test2) {
   delete BB;
 }
 
+// Same checks against the lock-free backend
+TEST(PCTest, TestLockFree) {
+  BoundedBuffer<int> *BB = new BoundedBuffer<int>(5, BB_LOCKFREE);
+  EXPECT_TRUE(BB->isEmpty());
+  BB->append(0);
+  BB->append(1);
+  EXPECT_FALSE(BB->isEmpty());
+  ASSERT_EQ(0, BB->remove());
+  ASSERT_EQ(1, BB->remove());
+  EXPECT_TRUE(BB->isEmpty());
+
+  delete BB;
+}
+
+// Many producers and consumers through a tiny lock-free ring: every item
+// must come out exactly once, which exercises the full/empty futex paths.
+TEST(PCTest, TestLockFreeConcurrent) {
+  BoundedBuffer<int> *BB = new BoundedBuffer<int>(2, BB_LOCKFREE);
+  const int threads = 4, per_thread = 5000;
+  atomic<long> sum{0};
+  vector<thread> workers;
+
+  for (int i = 0; i < threads; i++) {
+    workers.emplace_back([BB, i] {
+      for (int k = 0; k < per_thread; k++) BB->append(i * per_thread + k);
+    });
+    workers.emplace_back([BB, &sum] {
+      for (int k = 0; k < per_thread; k++) sum += BB->remove();
+    });
+  }
+  for (auto &w : workers) w.join();
+
+  long n = threads * per_thread;
+  EXPECT_EQ(sum.load(), n * (n - 1) / 2);
+  EXPECT_TRUE(BB->isEmpty());
+
+  delete BB;
+}
+
+// Batched append/remove must keep FIFO order across wrap-around and spans
+// larger than the buffer, for both backends.
+TEST(PCTest, TestBatched) {
+  for (int mode : {BB_MUTEX, BB_LOCKFREE}) {
+    BoundedBuffer<int> *BB = new BoundedBuffer<int>(4, mode);
+    int in[10], out[10];
+    for (int i = 0; i < 10; i++) in[i] = i;
+
+    thread producer([BB, &in] { BB->append_n(in, 10); });
+    int got = 0;
+    while (got < 10) {
+      int n = BB->remove_up_to(out + got, 10 - got);
+      EXPECT_GE(n, 1);
+      EXPECT_LE(n, 4);
+      got += n;
+    }
+    producer.join();
+
+    for (int i = 0; i < 10; i++) EXPECT_EQ(out[i], i);
+    EXPECT_TRUE(BB->isEmpty());
+    delete BB;
+  }
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
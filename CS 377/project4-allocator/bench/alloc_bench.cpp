@@ -0,0 +1,239 @@
+#include <getopt.h>
+#include <my_malloc.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// Trace-driven comparison of the free list placement policies.
+//
+// A trace is a list of "a <id> <bytes>" (allocate), "f <id>" (free) and
+// "r <id> <bytes>" (reallocate, replayed as a free and an allocation)
+// lines, the format of the CMU malloc lab traces. Trace files named on the
+// command line are replayed as they are; without any, four synthetic traces
+// are generated:
+//   random  log-uniform sizes from 16B to 16KB, freed in random order
+//   small   mostly bin-sized requests with some large ones mixed in
+//   holes   long- and short-lived blocks interleaved, the short-lived ones
+//           freed, then a second wave of requests that may or may not fit
+//           the holes they left
+//   ramp    steadily growing requests, each freed a while later
+//
+// Each trace is replayed under every policy on a fresh heap: once timed,
+// and once more to take these measurements:
+//   peak_heap  heap_high_water(), the bytes of heap the trace needed
+//   util       the most live requested bytes at any time / peak_heap
+//   ext_frag   when heap_in_use() peaked, the share of the heap below the
+//              high-water mark that was free but not handed out
+// Output is CSV on stdout.
+
+using namespace std;
+
+struct Op {
+  char kind;  // 'a' or 'f'
+  int id;
+  size_t size;
+};
+
+struct Trace {
+  string name;
+  vector<Op> ops;
+  int ids;  // ids are in [0, ids)
+};
+
+static const char *policy_names[] = {"first", "next", "best", "good"};
+
+static bool load_trace(const char *filename, Trace &t) {
+  FILE *f = fopen(filename, "r");
+  if (f == NULL) return false;
+  t.name = filename;
+  t.ids = 0;
+  char kind;
+  int id;
+  size_t size;
+  while (fscanf(f, " %c %d", &kind, &id) == 2) {
+    if (kind == 'a' || kind == 'r') {
+      if (fscanf(f, "%zu", &size) != 1) break;
+      if (kind == 'r') t.ops.push_back(Op{'f', id, 0});
+      t.ops.push_back(Op{'a', id, size});
+    } else if (kind == 'f') {
+      t.ops.push_back(Op{'f', id, 0});
+    } else {
+      break;
+    }
+    t.ids = max(t.ids, id + 1);
+  }
+  fclose(f);
+  return true;
+}
+
+// Appends allocations and frees until `n` ops, keeping about `live` blocks
+// alive; `size` draws the request sizes.
+template <typename Size>
+static Trace churn(const char *name, int n, int live, Size size) {
+  mt19937 rng(377);
+  Trace t = {name, {}, 0};
+  vector<int> alive;
+  while ((int)t.ops.size() < n) {
+    if (alive.empty() || ((int)alive.size() < live && rng() % 2 == 0) ||
+        rng() % live > (unsigned)alive.size()) {
+      t.ops.push_back(Op{'a', t.ids, size(rng)});
+      alive.push_back(t.ids++);
+    } else {
+      int k = rng() % alive.size();
+      t.ops.push_back(Op{'f', alive[k], 0});
+      alive[k] = alive.back();
+      alive.pop_back();
+    }
+  }
+  for (int id : alive) t.ops.push_back(Op{'f', id, 0});
+  return t;
+}
+
+static vector<Trace> synthetic_traces(int n) {
+  vector<Trace> traces;
+  traces.push_back(churn("random", n, 2000, [](mt19937 &rng) {
+    return (size_t)exp2(4 + (rng() % 1000) / 100.0);
+  }));
+  traces.push_back(churn("small", n, 2000, [](mt19937 &rng) {
+    return rng() % 10 ? (size_t)(16 + rng() % SMALL_MAX) : 512 + rng() % 3584;
+  }));
+
+  mt19937 rng(377);
+  Trace holes = {"holes", {}, 0};
+  while ((int)holes.ops.size() < n) {
+    int first = holes.ids;
+    for (int i = 0; i < 1000; i++) {
+      holes.ops.push_back(Op{'a', holes.ids++, 272 + rng() % 1776});
+    }
+    for (int i = first; i < holes.ids; i += 2) {
+      holes.ops.push_back(Op{'f', i, 0});
+    }
+    int second = holes.ids;
+    for (int i = 0; i < 500; i++) {
+      holes.ops.push_back(Op{'a', holes.ids++, 272 + rng() % 1776});
+    }
+    for (int i = first + 1; i < second; i += 2) {
+      holes.ops.push_back(Op{'f', i, 0});
+    }
+    for (int i = second; i < holes.ids; i++) {
+      holes.ops.push_back(Op{'f', i, 0});
+    }
+  }
+  traces.push_back(holes);
+
+  Trace ramp = {"ramp", {}, 0};
+  const int lag = 64;
+  for (int i = 0; (int)ramp.ops.size() < n; i++) {
+    ramp.ops.push_back(Op{'a', ramp.ids++, 16 + (size_t)(i % 4096) * 4});
+    if (i >= lag) ramp.ops.push_back(Op{'f', i - lag, 0});
+  }
+  for (int i = max(0, ramp.ids - lag); i < ramp.ids; i++) {
+    ramp.ops.push_back(Op{'f', i, 0});
+  }
+  traces.push_back(ramp);
+  return traces;
+}
+
+// Replays `t` once on a fresh heap under `policy`. With `measure`, also
+// tracks live bytes and the fragmentation at the heap_in_use() peak.
+static void replay(const Trace &t, int policy, bool measure, long *failed,
+                   size_t *peak_live, double *ext_frag) {
+  reset_heap();
+  set_fit_policy(policy);
+  vector<void *> ptr(t.ids, (void *)NULL);
+  vector<size_t> len(t.ids, 0);
+  size_t live = 0, peak_in_use = 0;
+  *failed = 0;
+  *peak_live = 0;
+  *ext_frag = 0;
+
+  for (const Op &op : t.ops) {
+    if (op.kind == 'a') {
+      ptr[op.id] = my_malloc(op.size);
+      if (ptr[op.id] == NULL) {
+        (*failed)++;
+        continue;
+      }
+      if (!measure) continue;
+      live += op.size;
+      len[op.id] = op.size;
+      if (live > *peak_live) *peak_live = live;
+      if (heap_in_use() > peak_in_use) {
+        peak_in_use = heap_in_use();
+        *ext_frag = 1.0 - (double)peak_in_use / heap_high_water();
+      }
+    } else if (ptr[op.id] != NULL) {
+      my_free(ptr[op.id]);
+      ptr[op.id] = NULL;
+      live -= len[op.id];
+    }
+  }
+}
+
+static void usage(char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-n ops] [-p policies] [trace_file ...]\n"
+          "  -n ops       length of each synthetic trace (default 200000)\n"
+          "  -p policies  comma-separated subset of first,next,best,good\n",
+          prog);
+  exit(-1);
+}
+
+int main(int argc, char *argv[]) {
+  int n = 200000;
+  vector<int> policies = {FIT_FIRST, FIT_NEXT, FIT_BEST, FIT_GOOD};
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:p:")) != -1) {
+    switch (opt) {
+      case 'n':
+        n = atoi(optarg);
+        if (n <= 0) usage(argv[0]);
+        break;
+      case 'p':
+        policies.clear();
+        for (char *s = strtok(optarg, ","); s != NULL; s = strtok(NULL, ",")) {
+          int p = 0;
+          while (p < 4 && strcmp(s, policy_names[p]) != 0) p++;
+          if (p == 4) usage(argv[0]);
+          policies.push_back(p);
+        }
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  vector<Trace> traces;
+  for (int i = optind; i < argc; i++) {
+    Trace t;
+    if (!load_trace(argv[i], t)) {
+      fprintf(stderr, "cannot read trace %s\n", argv[i]);
+      return -1;
+    }
+    traces.push_back(t);
+  }
+  if (traces.empty()) traces = synthetic_traces(n);
+
+  printf("trace,policy,ops,failed,seconds,ops_per_sec,peak_heap,util,ext_frag\n");
+  for (const Trace &t : traces) {
+    for (int policy : policies) {
+      long failed;
+      size_t peak_live;
+      double ext_frag;
+      auto start = chrono::steady_clock::now();
+      replay(t, policy, false, &failed, &peak_live, &ext_frag);
+      double secs =
+          chrono::duration<double>(chrono::steady_clock::now() - start).count();
+      replay(t, policy, true, &failed, &peak_live, &ext_frag);
+
+      size_t peak_heap = heap_high_water();
+      printf("%s,%s,%zu,%ld,%.4f,%.0f,%zu,%.3f,%.3f\n", t.name.c_str(),
+             policy_names[policy], t.ops.size(), failed, secs,
+             t.ops.size() / secs, peak_heap,
+             peak_heap ? (double)peak_live / peak_heap : 0.0, ext_frag);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,137 @@
+#include <getopt.h>
+#include <my_malloc.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Multithreaded malloc/free stress test, and a scaling curve against glibc.
+//
+// Each thread runs `ops` allocations, keeping about `live` blocks alive and
+// freeing a random one of them for each new one. Nine requests in ten are
+// small (16 to 256 bytes), the rest up to 4KB. Every `remote`-th block is
+// handed to the next thread through a one-slot mailbox and freed there, so
+// blocks regularly die on a thread other than the one that allocated them.
+//
+// The same workload runs on glibc malloc and on my_malloc in thread-safe
+// mode, with 1, 2, 4, ... up to `threads` threads. Output is CSV on stdout;
+// speedup is the throughput relative to one thread on the same allocator.
+
+using namespace std;
+
+struct Allocator {
+  const char *name;
+  void *(*alloc)(size_t);
+  void (*release)(void *);
+};
+
+static const Allocator allocators[] = {
+    {"glibc", malloc, free},
+    {"my_malloc", my_malloc, my_free},
+};
+
+static void worker(const Allocator &a, int t, int threads, int ops, int live,
+                   int remote, vector<atomic<void *>> &mailbox) {
+  mt19937 rng(377 + t);
+  vector<void *> blocks;
+  blocks.reserve(live + 1);
+  for (int i = 0; i < ops; i++) {
+    size_t size = rng() % 10 ? 16 + rng() % 241 : 257 + rng() % 3840;
+    void *p = a.alloc(size);
+    *(char *)p = (char)i;  // touch it, as a real program would
+    if (remote > 0 && i % remote == 0) {
+      p = mailbox[(t + 1) % threads].exchange(p);
+      if (p == NULL) continue;
+    }
+    blocks.push_back(p);
+    if ((int)blocks.size() > live) {
+      int k = rng() % blocks.size();
+      a.release(blocks[k]);
+      blocks[k] = blocks.back();
+      blocks.pop_back();
+    }
+  }
+  for (void *p : blocks) a.release(p);
+}
+
+// Runs the workload on `threads` threads and returns the seconds it took.
+static double run(const Allocator &a, int threads, int ops, int live,
+                  int remote) {
+  if (a.alloc == my_malloc) {
+    reset_heap();
+    set_thread_safe(true);
+  }
+  vector<atomic<void *>> mailbox(threads);
+  for (auto &m : mailbox) m.store(NULL);
+
+  auto start = chrono::steady_clock::now();
+  vector<thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back(worker, cref(a), t, threads, ops, live, remote,
+                         ref(mailbox));
+  }
+  for (thread &w : workers) w.join();
+  for (auto &m : mailbox) {
+    if (m.load() != NULL) a.release(m.load());
+  }
+  double secs =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  if (a.alloc == my_malloc) set_thread_safe(false);
+  return secs;
+}
+
+static void usage(char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-t threads] [-n ops] [-l live] [-r remote]\n"
+          "  -t threads  most threads to run (default 8)\n"
+          "  -n ops      allocations per thread (default 1000000)\n"
+          "  -l live     blocks each thread keeps alive (default 1000)\n"
+          "  -r remote   free every r-th block on another thread, 0 for "
+          "never (default 8)\n",
+          prog);
+  exit(-1);
+}
+
+int main(int argc, char *argv[]) {
+  int max_threads = 8, ops = 1000000, live = 1000, remote = 8;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "t:n:l:r:")) != -1) {
+    switch (opt) {
+      case 't':
+        max_threads = atoi(optarg);
+        if (max_threads <= 0) usage(argv[0]);
+        break;
+      case 'n':
+        ops = atoi(optarg);
+        if (ops <= 0) usage(argv[0]);
+        break;
+      case 'l':
+        live = atoi(optarg);
+        if (live <= 0) usage(argv[0]);
+        break;
+      case 'r':
+        remote = atoi(optarg);
+        if (remote < 0) usage(argv[0]);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  printf("allocator,threads,ops,seconds,ops_per_sec,speedup\n");
+  for (const Allocator &a : allocators) {
+    double base = 0;
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+      double secs = run(a, threads, ops, live, remote);
+      double rate = (double)threads * ops / secs;
+      if (threads == 1) base = rate;
+      printf("%s,%d,%ld,%.4f,%.0f,%.2f\n", a.name, threads,
+             (long)threads * ops, secs, rate, rate / base);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,117 @@
+#include <getopt.h>
+#include <my_malloc.h>
+#include <pool.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// Object pools against my_malloc() for small fixed-size objects.
+//
+// For each object size from 16 to 64 bytes, two workloads run on a fresh
+// heap, once with my_malloc()/my_free() and once with a pool:
+//   batch  allocate `n` objects, free them all in random order, repeat
+//   churn  keep `n` objects alive, freeing a random one for each new one
+// bytes_per_obj is heap_in_use() at the peak divided by the objects alive
+// then, which shows what headers and rounding cost on top of the object.
+// Output is CSV on stdout.
+
+using namespace std;
+
+static const size_t sizes[] = {16, 24, 32, 48, 64};
+
+struct Result {
+  long ops;
+  double seconds;
+  double bytes_per_obj;
+};
+
+// Runs `pattern` with `alloc`/`release`, which hand out objects of one size.
+template <typename Alloc, typename Release>
+static Result run(const char *pattern, int n, int rounds, Alloc alloc,
+                  Release release) {
+  mt19937 rng(377);
+  vector<void *> objs;
+  objs.reserve(n);
+  Result r = {0, 0, 0};
+  size_t peak = 0;
+
+  auto start = chrono::steady_clock::now();
+  if (pattern[0] == 'b') {
+    for (int round = 0; round < rounds; round++) {
+      for (int i = 0; i < n; i++) objs.push_back(alloc());
+      if (round == 0) peak = heap_in_use();
+      shuffle(objs.begin(), objs.end(), rng);
+      for (void *p : objs) release(p);
+      objs.clear();
+      r.ops += 2L * n;
+    }
+  } else {
+    for (int i = 0; i < n; i++) objs.push_back(alloc());
+    peak = heap_in_use();
+    for (long i = 0; i < (long)n * rounds; i++) {
+      int k = rng() % n;
+      release(objs[k]);
+      objs[k] = alloc();
+    }
+    for (void *p : objs) release(p);
+    r.ops = 2L * n * (rounds + 1);
+  }
+  r.seconds =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  r.bytes_per_obj = (double)peak / n;
+  return r;
+}
+
+static void report(size_t size, const char *pattern, const char *allocator,
+                   const Result &r) {
+  printf("%zu,%s,%s,%ld,%.4f,%.0f,%.1f\n", size, pattern, allocator, r.ops,
+         r.seconds, r.ops / r.seconds, r.bytes_per_obj);
+}
+
+static void usage(char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-n objects] [-r rounds]\n"
+          "  -n objects  objects alive at once (default 100000)\n"
+          "  -r rounds   times each workload repeats (default 20)\n",
+          prog);
+  exit(-1);
+}
+
+int main(int argc, char *argv[]) {
+  int n = 100000, rounds = 20;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+    switch (opt) {
+      case 'n':
+        n = atoi(optarg);
+        if (n <= 0) usage(argv[0]);
+        break;
+      case 'r':
+        rounds = atoi(optarg);
+        if (rounds <= 0) usage(argv[0]);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  printf("size,pattern,allocator,ops,seconds,ops_per_sec,bytes_per_obj\n");
+  for (size_t size : sizes) {
+    for (const char *pattern : {"batch", "churn"}) {
+      reset_heap();
+      Result r = run(pattern, n, rounds, [size] { return my_malloc(size); },
+                     [](void *p) { my_free(p); });
+      report(size, pattern, "my_malloc", r);
+
+      reset_heap();
+      pool_t *pool = pool_create(size);
+      r = run(pattern, n, rounds, [pool] { return pool_alloc(pool); },
+              [pool](void *p) { pool_free(pool, p); });
+      report(size, pattern, "pool", r);
+      pool_destroy(pool);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,166 @@
+#include <getopt.h>
+#include <my_malloc.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+// Append-heavy growth patterns: my_realloc() against allocate-copy-free
+// with my_malloc() and against glibc realloc().
+//
+//   append       one buffer grown by `step` bytes at a time, as a reader
+//                appending input would
+//   interleaved  `buffers` buffers grown by turns, so each one's neighbor
+//                is usually another buffer rather than free memory
+//   noisy        one buffer grown while small short-lived objects are
+//                allocated and freed around it
+//   calloc       `appends` / 100 zeroed 64KB blocks on a fresh heap, freed
+//                at the end; "copy" stands for my_malloc() plus memset()
+//
+// moves counts resizes that returned a different pointer, and copied the
+// bytes those had to copy. Output is CSV on stdout.
+
+using namespace std;
+
+struct Allocator {
+  const char *name;
+  void *(*resize)(void *, size_t, size_t);  // ptr, old size, new size
+  void *(*zeroed)(size_t);
+  void (*release)(void *);
+};
+
+static void *copy_resize(void *ptr, size_t old, size_t size) {
+  void *moved = my_malloc(size);
+  if (ptr != NULL) {
+    memcpy(moved, ptr, old);
+    my_free(ptr);
+  }
+  return moved;
+}
+
+static void *zeroed_malloc(size_t size) { return memset(my_malloc(size), 0, size); }
+static void *my_resize(void *ptr, size_t, size_t size) { return my_realloc(ptr, size); }
+static void *my_zeroed(size_t size) { return my_calloc(1, size); }
+static void *glibc_resize(void *ptr, size_t, size_t size) { return realloc(ptr, size); }
+static void *glibc_zeroed(size_t size) { return calloc(1, size); }
+
+static const Allocator allocators[] = {
+    {"my_realloc", my_resize, my_zeroed, my_free},
+    {"copy", copy_resize, zeroed_malloc, my_free},
+    {"glibc", glibc_resize, glibc_zeroed, free},
+};
+
+struct Result {
+  long ops;
+  long moves;
+  size_t copied;
+  double seconds;
+};
+
+// Grows `buf` from `len` to `len + step` bytes, counting a move if it moved.
+static void grow(const Allocator &a, char *&buf, size_t &len, size_t step,
+                 Result &r) {
+  char *grown = (char *)a.resize(buf, len, len + step);
+  if (buf != NULL && grown != buf) {
+    r.moves++;
+    r.copied += len;
+  }
+  memset(grown + len, 'x', step);
+  buf = grown;
+  len += step;
+  r.ops++;
+}
+
+static Result run(const Allocator &a, const char *pattern, int n, size_t step,
+                  int buffers) {
+  Result r = {0, 0, 0, 0};
+  reset_heap();
+  auto start = chrono::steady_clock::now();
+
+  if (strcmp(pattern, "append") == 0) {
+    char *buf = NULL;
+    size_t len = 0;
+    for (int i = 0; i < n; i++) grow(a, buf, len, step, r);
+    a.release(buf);
+  } else if (strcmp(pattern, "interleaved") == 0) {
+    vector<char *> bufs(buffers, (char *)NULL);
+    vector<size_t> lens(buffers, 0);
+    for (int i = 0; i < n; i++) {
+      grow(a, bufs[i % buffers], lens[i % buffers], step, r);
+    }
+    for (char *b : bufs) a.release(b);
+  } else if (strcmp(pattern, "noisy") == 0) {
+    char *buf = NULL;
+    size_t len = 0;
+    vector<void *> noise;
+    for (int i = 0; i < n; i++) {
+      grow(a, buf, len, step, r);
+      if (i % 4 == 0) {
+        noise.push_back(a.resize(NULL, 0, 32 + i % 200));
+        if (noise.size() > 8) {
+          a.release(noise.front());
+          noise.erase(noise.begin());
+        }
+      }
+    }
+    for (void *p : noise) a.release(p);
+    a.release(buf);
+  } else {
+    vector<char *> blocks;
+    for (int i = 0; i < n; i++) {
+      blocks.push_back((char *)a.zeroed(64 << 10));
+      r.ops++;
+    }
+    for (char *b : blocks) a.release(b);
+  }
+
+  r.seconds =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  return r;
+}
+
+static void usage(char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-n appends] [-s step] [-b buffers]\n"
+          "  -n appends  appends per pattern (default 100000)\n"
+          "  -s step     bytes per append (default 16)\n"
+          "  -b buffers  buffers for interleaved (default 16)\n",
+          prog);
+  exit(-1);
+}
+
+int main(int argc, char *argv[]) {
+  int n = 100000, buffers = 16;
+  size_t step = 16;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:s:b:")) != -1) {
+    switch (opt) {
+      case 'n':
+        n = atoi(optarg);
+        if (n <= 0) usage(argv[0]);
+        break;
+      case 's':
+        step = atoi(optarg);
+        if (step == 0) usage(argv[0]);
+        break;
+      case 'b':
+        buffers = atoi(optarg);
+        if (buffers <= 0) usage(argv[0]);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  printf("pattern,allocator,ops,seconds,ops_per_sec,moves,copied\n");
+  for (const char *pattern : {"append", "interleaved", "noisy", "calloc"}) {
+    int count = pattern[0] == 'c' ? max(1, n / 100) : n;
+    for (const Allocator &a : allocators) {
+      Result r = run(a, pattern, count, step, buffers);
+      printf("%s,%s,%ld,%.4f,%.0f,%ld,%zu\n", pattern, a.name, r.ops,
+             r.seconds, r.ops / r.seconds, r.moves, r.copied);
+    }
+  }
+  return 0;
+}
@@ -14,40 +14,116 @@
 #endif
 
 // Some important constants.
-#define HEAP_SIZE 4096
+#define HEAP_SIZE 4096  // the first chunk of the heap
 #define MAGIC 0xDEADBEEF
 
+// Heap growth. When nothing on the free list fits, another chunk is mapped:
+// twice the size of the previous one, up to CHUNK_MAX, or bigger if a
+// single request needs it. With huge pages on (see set_heap_growth()),
+// chunks of HUGE_PAGE_SIZE or more are rounded to and aligned on huge page
+// boundaries. A chunk other than the first that becomes entirely free is
+// unmapped as long as the rest of the heap still has `release_threshold`
+// (RELEASE_THRESHOLD by default) bytes free. A nonzero `max_heap` caps the
+// bytes mapped in all; requests past it fail instead of growing the heap.
+#define CHUNK_MAX (64 << 20)
+#define HUGE_PAGE_SIZE (2 << 20)
+#define RELEASE_THRESHOLD (128 << 10)
+
+// Every block's payload is a multiple of ALIGNMENT bytes. Payloads up to
+// SMALL_MAX are recycled through NUM_BINS exact-size bins (16, 32, ...,
+// SMALL_MAX bytes) instead of the free list.
+#define ALIGNMENT 16
+#define NUM_BINS 16
+#define SMALL_MAX (NUM_BINS * ALIGNMENT)
+
+// Boundary tags. Sizes are multiples of ALIGNMENT, so the low bits of every
+// block's size field are free to carry these flags:
+#define BLOCK_FREE 0x1  // the block is on the free list
+#define PREV_FREE 0x2   // the block physically before it is on the free list
+#define SIZE_FLAGS (ALIGNMENT - 1)
+// A block on the free list also keeps a link to the previous list node in
+// its first payload word and a copy of its size in its last payload word
+// (its footer), so a block being freed finds and unlinks free neighbors on
+// either side in O(1). Blocks in bins count as allocated to their
+// neighbors until consolidate() moves them to the free list.
+
+// Thread-safe mode, see set_thread_safe(). Each thread caches small blocks
+// of its own, up to CACHE_MAX per size class, and takes them from the heap
+// or gives them back CACHE_BATCH at a time. At most MAX_CACHES threads have
+// a cache at once; the others go to the heap for every block.
+#define MAX_CACHES 64
+#define CACHE_BATCH 16
+#define CACHE_MAX 64
+
+// Placement policies for the free list, see set_fit_policy().
+#define FIT_FIRST 0  // lowest-addressed block that fits (the default)
+#define FIT_NEXT 1   // first fit, resuming where the last search stopped
+#define FIT_BEST 2   // smallest block that fits, by walking the whole list
+#define FIT_GOOD 3   // smallest block that fits, from a size-ordered tree
+
 // This struct is used as the header of an allocated block.
 typedef struct __header_t {
-  size_t size;  // the number of bytes of allocated memory
+  size_t size;  // the number of bytes of allocated memory, plus flags
   unsigned int
       magic;  // the magic number used to identify a valid allocated block
+  unsigned short owner;  // the thread cache the block came from (1 to
+                         // MAX_CACHES), or 0 if it came from the heap
+  unsigned short bin;    // for a cached block, the bin it goes back to;
+                         // the heap may set flags in `size` meanwhile
 } header_t;
 
 // This struct is used for the free list.
 typedef struct __node_t {
-  size_t size;            // the number of bytes available in this free block
+  size_t size;            // the number of bytes available in this free block,
+                          // plus flags
   struct __node_t *next;  // a pointer to the next free list node
 } node_t;
 
+// Each chunk ends in a fence, a node_t of size 0 that is never free, so a
+// walk from block to block stops at the end of its chunk. The chunk_t
+// describing the chunk sits right after the fence.
+typedef struct __chunk_t {
+  node_t *base;             // the chunk's first block
+  size_t size;              // bytes of blocks, up to the fence
+  size_t reach;             // furthest any allocation has reached into it
+  void *map;                // what to munmap, and how much
+  size_t map_size;
+  struct __chunk_t *prev;   // chunks are kept in address order
+  struct __chunk_t *next;
+} chunk_t;
 
 // This is the primary interface.
 void *my_malloc(size_t);
 void my_free(void *);
+void *my_realloc(void *ptr, size_t size);
+void *my_calloc(size_t count, size_t size);
+void set_fit_policy(int policy);
+int get_fit_policy();
+void set_heap_growth(bool huge_pages, size_t release_threshold,
+                     size_t max_heap);
+void set_thread_safe(bool on);
 
-// We expose these functions for testing purposes.
+// We expose these functions for testing purposes. None of them, nor the
+// setters above, take the heap lock: call them while only one thread is
+// using the allocator.
 void reset_heap();
 node_t *heap();
 node_t *free_list();
 size_t available_memory();
 int number_of_free_nodes();
+size_t heap_in_use();
+size_t heap_high_water();
+size_t heap_mapped();
+int heap_chunks();
 void print_free_list();
 void find_free(size_t size, node_t **found, node_t **previous);
 void split(size_t size, node_t **previous, node_t **free_block,
            header_t **allocated);
-void coalesce(node_t *free_block);
+node_t *coalesce(node_t *free_block);
+bool consolidate();
 
 extern node_t *head;
 extern node_t *tail;
+extern node_t *bins[NUM_BINS];
 
 #endif
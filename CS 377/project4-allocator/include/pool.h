@@ -0,0 +1,45 @@
+#ifndef __POOL_H
+#define __POOL_H
+#include <my_malloc.h>
+
+// Object pools for fixed-size objects, layered on my_malloc().
+//
+// A pool takes memory from my_malloc() a slab at a time and hands it out in
+// objects of the pool's size, packed back to back with no header. Free
+// objects are kept on the pool's free list, linked through their first
+// word, so allocating and freeing are a few instructions each and never
+// search anything. Slabs only go back to my_malloc() all at once, with
+// pool_release() or pool_destroy().
+//
+// A pool is not thread-safe; give each thread its own.
+
+// Objects are rounded up to a multiple of POOL_ALIGN bytes (at least one
+// pointer), and a slab holds POOL_SLAB_SIZE bytes of them, or one object if
+// that is bigger.
+#define POOL_ALIGN sizeof(void *)
+#define POOL_SLAB_SIZE 4096
+
+// The first bytes of every slab, before its objects.
+typedef struct __slab_t {
+  struct __slab_t *next;  // the slab allocated before this one
+  size_t pad;             // keeps the first object ALIGNMENT-aligned
+} slab_t;
+
+typedef struct __pool_t {
+  size_t obj_size;   // bytes per object, rounded up
+  size_t slab_size;  // bytes of objects per slab
+  void *free;        // freed objects, linked through their first word
+  char *carve;       // the part of the newest slab never handed out,
+  char *carve_end;   // from carve up to carve_end
+  slab_t *slabs;     // every slab, newest first
+  size_t live;       // objects handed out and not freed
+  size_t num_slabs;
+} pool_t;
+
+pool_t *pool_create(size_t obj_size);
+void *pool_alloc(pool_t *pool);
+void pool_free(pool_t *pool, void *obj);
+void pool_release(pool_t *pool);
+void pool_destroy(pool_t *pool);
+
+#endif
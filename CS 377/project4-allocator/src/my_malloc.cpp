@@ -1,36 +1,365 @@
 #include <assert.h>
 #include <my_malloc.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <set>
+#include <utility>
 
 // A pointer to the head of the free list.
 node_t *head = NULL;
 node_t *tail = NULL;
 
+// Every mapped chunk, in address order. The first chunk is never unmapped
+// before reset_heap(), and its fence is `tail`, which also ends the free
+// list (the free list runs through all the chunks).
+static chunk_t *chunks = NULL;
+static chunk_t *first = NULL;
+
+// Bytes of blocks mapped in all chunks, and how many chunks there are.
+static size_t mapped = 0;
+static int num_chunks = 0;
+
+// The size of the next chunk to map, doubled each time up to CHUNK_MAX.
+static size_t grow_size = 2 * HEAP_SIZE;
+
+// See set_heap_growth().
+static bool huge_pages = false;
+static size_t release_threshold = RELEASE_THRESHOLD;
+static size_t max_heap = 0;
+
+// Room for a fence and its chunk_t after a chunk's blocks, keeping the
+// blocks a multiple of ALIGNMENT long.
+#define CHUNK_OVERHEAD \
+  ((sizeof(node_t) + sizeof(chunk_t) + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1))
+
+// Small free blocks, one LIFO list per size class: bins[i] holds blocks
+// whose payload is exactly (i + 1) * ALIGNMENT bytes. Pushing and popping
+// is O(1); the blocks are only merged with their neighbors by consolidate().
+node_t *bins[NUM_BINS];
+
+// The placement policy find_free() uses on the free list.
+static int fit = FIT_FIRST;
+
+// FIT_NEXT: the free list node the next search starts at, or NULL to start
+// at head. Kept pointing into the list as nodes are split or merged.
+static node_t *rover = NULL;
+
+// FIT_GOOD: every free list node ordered by (size, address). Only
+// maintained while FIT_GOOD is the policy.
+static std::set<std::pair<size_t, node_t *>> by_size;
+
+// Bytes of the heap held by allocated blocks (headers included); how far
+// allocated blocks reach into their chunks, summed over the chunks; and the
+// most that sum has ever been.
+static size_t in_use = 0;
+static size_t reach_total = 0;
+static size_t high_water = 0;
+
+// The part of the block heap_malloc() last returned that has not been
+// written since its chunk was mapped, and so is still zero, from zero_from
+// up to zero_to (both NULL if nothing is known). See note_reach().
+static char *zero_from = NULL;
+static char *zero_to = NULL;
+
+// Thread-safe mode. The heap, everything above, is guarded by `heap_lock`.
+// Small blocks are handed out from per-thread caches, which take and give
+// back whole batches of blocks under the lock, so most calls never touch
+// it. A cached block belongs to its cache, and its header says which one:
+// a thread freeing a block of another thread's cache pushes it, lock-free,
+// onto that cache's `remote` stack, which the owner takes over in one
+// exchange when its own bin runs dry.
+//
+// The cache side never reads a cached block's `size`: the heap sets and
+// clears PREV_FREE in it, under the lock, whenever the block before it is
+// freed or allocated. A cached block's size class is kept in its header's
+// `bin` instead, and bins and remote stacks link blocks through their first
+// payload word, so `magic`, `owner` and `bin` stay as the heap left them.
+static bool thread_safe = false;
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct alignas(64) thread_cache_t {
+  node_t *bins[NUM_BINS];       // like the heap's bins, but never merged
+  int counts[NUM_BINS];
+  std::atomic<node_t *> remote;  // blocks freed by other threads
+  std::atomic<bool> taken;       // a live thread owns the cache
+};
+static thread_cache_t caches[MAX_CACHES];
+
+// The calling thread's cache, or NULL before its first small request and
+// when every cache was taken (`no_cache`).
+static thread_local thread_cache_t *cache = NULL;
+static thread_local bool no_cache = false;
+
+// Rounds a request up to a whole number of ALIGNMENT units (at least one).
+static inline size_t round_up(size_t size) {
+  if (size == 0) size = 1;
+  return (size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+}
+
+// The bin for a small payload size (a multiple of ALIGNMENT).
+static inline int bin_index(size_t size) { return size / ALIGNMENT - 1; }
+
+// A block's payload size without the flag bits.
+static inline size_t size_of(const node_t *block) {
+  return block->size & ~(size_t)SIZE_FLAGS;
+}
+
+// Sets a block's payload size, keeping its flags.
+static inline void set_size(node_t *block, size_t size) {
+  block->size = size | (block->size & SIZE_FLAGS);
+}
+
+// The block physically after `block` (its chunk's fence for the last one).
+static inline node_t *next_block(node_t *block) {
+  return (node_t *)((char *)block + sizeof(node_t) + size_of(block));
+}
+
+// The block physically before `block`. Only valid with PREV_FREE set, when
+// the word just before `block` is that block's footer.
+static inline node_t *prev_block(node_t *block) {
+  size_t size = *((size_t *)block - 1);
+  return (node_t *)((char *)block - size - sizeof(node_t));
+}
+
+// The free list link back to the previous node (NULL for head), kept in
+// the first payload word of a free block.
+static inline node_t *&prev_link(node_t *block) {
+  return *(node_t **)(block + 1);
+}
+
+// The chunk a fence ends.
+static inline chunk_t *chunk_of(node_t *fence) {
+  return (chunk_t *)(fence + 1);
+}
+
+// Whether free list nodes are kept in address order. First fit and next
+// fit depend on it; best fit and good fit do not, and push freed blocks on
+// the front instead of searching for their place.
+static inline bool address_ordered() {
+  return fit == FIT_FIRST || fit == FIT_NEXT;
+}
+
+// Tags `block` as free: flag, footer, and the next block's PREV_FREE.
+static void mark_free(node_t *block) {
+  block->size |= BLOCK_FREE;
+  *((size_t *)next_block(block) - 1) = size_of(block);
+  next_block(block)->size |= PREV_FREE;
+}
+
+// Links `block` into the free list after `after` (NULL for the front).
+static void list_insert(node_t *block, node_t *after) {
+  node_t *next = after != NULL ? after->next : head;
+  block->next = next;
+  prev_link(block) = after;
+  if (next != tail) {
+    prev_link(next) = block;
+  }
+  if (after != NULL) {
+    after->next = block;
+  } else {
+    head = block;
+  }
+  if (fit == FIT_GOOD) {
+    by_size.insert(std::make_pair(size_of(block), block));
+  }
+}
+
+// Unlinks `block` from the free list. A rover left pointing at it moves on
+// to the following node.
+static void list_remove(node_t *block) {
+  node_t *prev = prev_link(block);
+  if (block->next != tail) {
+    prev_link(block->next) = prev;
+  }
+  if (prev != NULL) {
+    prev->next = block->next;
+  } else {
+    head = block->next;
+  }
+  if (rover == block) {
+    rover = block->next;
+  }
+  if (fit == FIT_GOOD) {
+    by_size.erase(std::make_pair(size_of(block), block));
+  }
+}
+
+// Rebuilds the free list, in address order, by walking every block of
+// every chunk and picking up those tagged BLOCK_FREE.
+static void rebuild_free_list() {
+  head = tail;
+  rover = NULL;
+  by_size.clear();
+  node_t *last = NULL;
+  for (chunk_t *chunk = chunks; chunk != NULL; chunk = chunk->next) {
+    for (node_t *block = chunk->base; size_of(block) != 0;
+         block = next_block(block)) {
+      if (block->size & BLOCK_FREE) {
+        list_insert(block, last);
+        last = block;
+      }
+    }
+  }
+}
+
+// Maps a chunk of `size` bytes of blocks (a multiple of ALIGNMENT), made of
+// one free block and its fence, and adds it to the chunk list. The block is
+// not put on the free list yet.
+//
+// RETURNS:
+// the chunk, or NULL if the OS has no memory to give
+//
+static chunk_t *map_chunk(size_t size) {
+  size_t map_size = size + CHUNK_OVERHEAD;
+  char *map;
+  if (huge_pages && map_size % HUGE_PAGE_SIZE == 0) {
+    // Map a huge page too many and trim both ends, so that the chunk starts
+    // on a boundary transparent huge pages can back.
+    char *raw = (char *)mmap(NULL, map_size + HUGE_PAGE_SIZE,
+                             PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+    if (raw == MAP_FAILED) {
+      return NULL;
+    }
+    map = (char *)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) &
+                   ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    if (map > raw) {
+      munmap(raw, map - raw);
+    }
+    if (map < raw + HUGE_PAGE_SIZE) {
+      munmap(map + map_size, raw + HUGE_PAGE_SIZE - map);
+    }
+    madvise(map, map_size, MADV_HUGEPAGE);
+  } else {
+    map = (char *)mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                       MAP_ANON | MAP_PRIVATE, -1, 0);
+    if (map == MAP_FAILED) {
+      return NULL;
+    }
+  }
+
+  node_t *block = (node_t *)map;
+  node_t *fence = (node_t *)(map + size);
+  fence->size = 0;
+  fence->next = NULL;
+  block->size = size - sizeof(node_t);  // The size does not include the header
+  mark_free(block);
+
+  chunk_t *chunk = chunk_of(fence);
+  chunk->base = block;
+  chunk->size = size;
+  chunk->reach = 0;
+  chunk->map = map;
+  chunk->map_size = map_size;
+  chunk_t *before = NULL;
+  for (chunk_t *c = chunks; c != NULL && c < chunk; c = c->next) {
+    before = c;
+  }
+  chunk->prev = before;
+  chunk->next = before != NULL ? before->next : chunks;
+  if (chunk->next != NULL) {
+    chunk->next->prev = chunk;
+  }
+  if (before != NULL) {
+    before->next = chunk;
+  } else {
+    chunks = chunk;
+  }
+  mapped += size;
+  num_chunks++;
+  return chunk;
+}
+
+// Takes a chunk off the chunk list and gives it back to the OS. Its block
+// must already be off the free list.
+static void unmap_chunk(chunk_t *chunk) {
+  if (chunk->prev != NULL) {
+    chunk->prev->next = chunk->next;
+  } else {
+    chunks = chunk->next;
+  }
+  if (chunk->next != NULL) {
+    chunk->next->prev = chunk->prev;
+  }
+  mapped -= chunk->size;
+  num_chunks--;
+  reach_total -= chunk->reach;
+  munmap(chunk->map, chunk->map_size);
+}
+
+// Maps a chunk big enough for a `size`-byte request: the next size in the
+// geometric sequence, or just enough for the request if that is more,
+// rounded up to whole pages (whole huge pages if huge pages are on and the
+// chunk is that big). Its block goes on the free list.
+//
+// RETURNS:
+// the new free block, or NULL if the heap cannot grow
+//
+static node_t *grow_heap(size_t size) {
+  size_t total = size + sizeof(header_t) + CHUNK_OVERHEAD;
+  if (total < grow_size) {
+    total = grow_size;
+  }
+  size_t page = huge_pages && total >= HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE
+                                                      : sysconf(_SC_PAGESIZE);
+  total = (total + page - 1) & ~(page - 1);
+  if (max_heap != 0 && mapped + total - CHUNK_OVERHEAD > max_heap) {
+    return NULL;
+  }
+  chunk_t *chunk = map_chunk(total - CHUNK_OVERHEAD);
+  if (chunk == NULL) {
+    return NULL;
+  }
+  if (grow_size < CHUNK_MAX) {
+    grow_size *= 2;
+  }
+  return coalesce(chunk->base);
+}
+
 // The heap function returns the head pointer to the free list. If the heap
 // has not been allocated yet (head is NULL) it will use mmap to allocate
-// a page of memory from the OS and initialize the first free node.
+// the first chunk from the OS and initialize the first free node.
 node_t *heap() {
   if (head == NULL) {
-    // This allocates the heap and initializes the head node.
-    head =
-        (node_t *)mmap(NULL, HEAP_SIZE + sizeof(node_t), PROT_READ | PROT_WRITE,
-                       MAP_ANON | MAP_PRIVATE, -1, 0);
-    tail = (node_t *)((char *)head +
-                      HEAP_SIZE);  // Set the tail to the end of the heap
-    head->size =
-        HEAP_SIZE - sizeof(node_t);  // THe size does not include the header
-    head->next = tail;
-    tail->size = 0;
-    tail->next = NULL;
+    // This allocates the first chunk and initializes the head node.
+    in_use = 0;
+    mapped = 0;
+    num_chunks = 0;
+    reach_total = 0;
+    high_water = 0;
+    grow_size = 2 * HEAP_SIZE;
+    first = map_chunk(HEAP_SIZE);
+    tail = next_block(first->base);  // Set the tail to the end of the chunk
+    head = tail;
+    list_insert(first->base, NULL);
+    for (int i = 0; i < NUM_BINS; i++) {
+      bins[i] = NULL;
+    }
   }
 
   return head;
 }
 
-// Reallocates the heap.
+// Reallocates the heap, unmapping every chunk. Blocks held in thread caches
+// are forgotten along with the rest.
 void reset_heap() {
-  if (head != NULL) {
-    munmap(head, HEAP_SIZE);
+  for (int i = 0; i < MAX_CACHES; i++) {
+    for (int j = 0; j < NUM_BINS; j++) {
+      caches[i].bins[j] = NULL;
+      caches[i].counts[j] = 0;
+    }
+    caches[i].remote.store(NULL);
+  }
+  if (first != NULL) {
+    while (chunks != NULL) {
+      unmap_chunk(chunks);
+    }
+    first = NULL;
     head = NULL;
+    rover = NULL;
+    by_size.clear();
     heap();
   }
 }
@@ -38,18 +367,24 @@ void reset_heap() {
 // Returns a pointer to the head of the free list.
 node_t *free_list() { return head; }
 
-// Calculates the amount of free memory available in the heap.
+// Calculates the amount of free memory available in the heap, on the free
+// list and in the bins.
 size_t available_memory() {
   size_t n = 0;
   node_t *p = heap();
   while (p != tail) {
-    n += p->size;
+    n += size_of(p);
     p = p->next;
   }
+  for (int i = 0; i < NUM_BINS; i++) {
+    for (p = bins[i]; p != NULL; p = p->next) {
+      n += size_of(p);
+    }
+  }
   return n;
 }
 
-// Returns the number of nodes on the free list.
+// Returns the number of free blocks, on the free list and in the bins.
 int number_of_free_nodes() {
   int count = 0;
   node_t *p = heap();
@@ -57,25 +392,99 @@ int number_of_free_nodes() {
     count++;
     p = p->next;
   }
+  for (int i = 0; i < NUM_BINS; i++) {
+    for (p = bins[i]; p != NULL; p = p->next) {
+      count++;
+    }
+  }
   return count;
 }
 
-// Prints the free list. Useful for debugging purposes.
+// Returns the number of heap bytes taken by allocated blocks, including
+// their headers and any rounding.
+size_t heap_in_use() { return in_use; }
+
+// Returns the most heap allocated blocks have ever reached into, summing
+// how far they reach into each chunk. This is the memory the program has
+// actually needed, however big the chunks are.
+size_t heap_high_water() { return high_water; }
+
+// Returns the bytes of blocks mapped in all chunks.
+size_t heap_mapped() { return mapped; }
+
+// Returns the number of chunks mapped.
+int heap_chunks() { return num_chunks; }
+
+// Sets how the heap grows from now on (see the constants in my_malloc.h):
+// whether big chunks use huge pages, how many free bytes must remain
+// elsewhere before an entirely free chunk is unmapped, and the most bytes
+// the heap may map (0 for no limit).
+void set_heap_growth(bool huge, size_t threshold, size_t limit) {
+  huge_pages = huge;
+  release_threshold = threshold;
+  max_heap = limit;
+}
+
+// Selects the placement policy (FIT_FIRST, FIT_NEXT, FIT_BEST or FIT_GOOD)
+// that find_free() uses from now on. Bins are exact-size and not affected.
+// The free list is rebuilt in address order, which suits every policy.
+void set_fit_policy(int policy) {
+  heap();
+  fit = policy;
+  rebuild_free_list();
+}
+
+// Returns the current placement policy.
+int get_fit_policy() { return fit; }
+
+// Prints the free list, then every non-empty bin. Useful for debugging
+// purposes.
 void print_free_list() {
   node_t *p = heap();
   while (p != tail) {
-    printf("Free(%zd)", p->size);
+    printf("Free(%zd)", size_of(p));
     p = p->next;
     if (p != NULL) {
       printf("->");
     }
   }
   printf("\n");
+  for (int i = 0; i < NUM_BINS; i++) {
+    int count = 0;
+    for (p = bins[i]; p != NULL; p = p->next) {
+      count++;
+    }
+    if (count > 0) {
+      printf("Bin(%d)x%d\n", (i + 1) * ALIGNMENT, count);
+    }
+  }
+}
+
+// First fit over part of the free list: the first node from `iter_node` up
+// to (not including) `stop` with at least `size` bytes.
+//
+// RETURNS:
+// the node found, or NULL
+//
+static node_t *first_fit(size_t size, node_t *iter_node, node_t *stop) {
+  while(iter_node != stop){
+    if(size_of(iter_node) >= size){
+      return iter_node;
+    }
+    iter_node = iter_node->next;
+  }
+  return NULL;
 }
 
 // Finds a node on the free list that has enough available memory to
-// allocate to a calling program. This function uses the "first-fit"
-// algorithm to locate a free node.
+// allocate to a calling program, using the policy set by set_fit_policy():
+//
+//   FIT_FIRST - the lowest-addressed node that fits.
+//   FIT_NEXT  - first fit, but starting where the previous search stopped
+//               (usually the remainder it split off) and wrapping around.
+//   FIT_BEST  - the smallest node that fits (an exact fit ends the walk).
+//   FIT_GOOD  - the smallest node that fits, looked up in O(log n) in the
+//               size-ordered tree.
 //
 // PARAMETERS:
 // size - the number of bytes requested to allocate
@@ -87,29 +496,77 @@ void print_free_list() {
 void find_free(size_t size, node_t **found, node_t **previous) {
   node_t *iter_node = heap();  // Get the head of the free list, initialize the
                                // heap if necessary
-  // TODO
-  node_t *prev = NULL;
-  while(iter_node != tail){
-    if(iter_node->size >= size){
-      *found = iter_node;
-      *previous = prev;
-      return;
-    }
-    prev = iter_node;
-    iter_node = iter_node->next;
+  node_t *best = NULL;
+
+  if (fit == FIT_NEXT) {
+    node_t *start = rover != NULL && rover != tail ? rover : iter_node;
+    best = first_fit(size, start, tail);
+    if (best == NULL) {
+      best = first_fit(size, iter_node, start);
+    }
+    if (best != NULL) {
+      rover = best;
+    }
+  } else if (fit == FIT_BEST) {
+    for (; iter_node != tail; iter_node = iter_node->next) {
+      if (size_of(iter_node) >= size &&
+          (best == NULL || size_of(iter_node) < size_of(best))) {
+        best = iter_node;
+        if (size_of(best) == size) break;
+      }
+    }
+  } else if (fit == FIT_GOOD) {
+    auto it = by_size.lower_bound(std::make_pair(size, (node_t *)NULL));
+    if (it != by_size.end()) {
+      best = it->second;
+    }
+  } else {
+    best = first_fit(size, iter_node, tail);
   }
-  *found = NULL;
-  *previous= prev;
 
-  return;
+  *found = best;
+  *previous = best != NULL ? prev_link(best) : NULL;
+}
+
+// Records how far `block`, just allocated out of a free block, reaches into
+// its chunk. `after` is the block that followed the free block; only if
+// that is the chunk's fence can `block` reach into memory never handed out.
+//
+// Past the old reach, the only words ever written are the header and free
+// list link of the free block that started at or before it, and the footer
+// just before the fence, so the rest of `block` up to there is still zero
+// from mmap. This sets zero_from and zero_to to that range.
+static void note_reach(node_t *block, node_t *after) {
+  zero_from = NULL;
+  zero_to = NULL;
+  if (size_of(after) != 0) {
+    return;
+  }
+  chunk_t *chunk = chunk_of(after);
+  zero_from = (char *)chunk->base + chunk->reach + sizeof(node_t) +
+              sizeof(node_t *);
+  zero_to = (char *)after - sizeof(size_t);
+
+  size_t reach = (char *)next_block(block) - (char *)chunk->base;
+  if (reach > chunk->reach) {
+    reach_total += reach - chunk->reach;
+    chunk->reach = reach;
+    if (reach_total > high_water) {
+      high_water = reach_total;
+    }
+  }
 }
 
 // Splits a found free node to accommodate an allocation request.
 //
 // The job of this function is to take a given free_node found from
 // `find_free` and split it according to the number of bytes to allocate.
-// In doing so, it will adjust the size and next pointer of the `free_block`
-// as well as the `previous` node to properly adjust the free list.
+// The remainder takes the free block's place on the free list, right after
+// `previous`, so the rest of the list is never searched.
+//
+// A remainder too small to hold a node with an ALIGNMENT-byte payload is
+// not split off; the allocation keeps it, and its header says so, so that
+// my_free() gives all of it back.
 //
 // PARAMETERS:
 // size - the number of bytes requested to allocate
@@ -122,43 +579,45 @@ void find_free(size_t size, node_t **found, node_t **previous) {
 void split(size_t size, node_t **previous, node_t **free_block,
            header_t **allocated) {
   assert(*free_block != NULL);
-  // TODO
   node_t *alloc_node = *free_block;
   size_t actualSize = size + sizeof(header_t);
+  bool at_rover = rover == alloc_node;
+  node_t *after = next_block(alloc_node);
+  list_remove(alloc_node);
 
-  if (alloc_node->size >= actualSize + sizeof(node_t)){
+  if (size_of(alloc_node) >= actualSize + sizeof(node_t) + ALIGNMENT){
     node_t *newNode = (node_t *)(((char *)alloc_node) + actualSize);
-    newNode->size = alloc_node->size - actualSize;
-    newNode->next = alloc_node->next;
-
-    
-    if(*previous == NULL){
-      head = newNode;
+    newNode->size = size_of(alloc_node) - actualSize;
+    mark_free(newNode);
+    list_insert(newNode, *previous);
+    if (at_rover) {
+      rover = newNode;
     }
-    else{
-      (*previous)->next = newNode; 
-    }
-    
-    (*free_block)->size = alloc_node->size - actualSize; 
 
     *free_block = newNode;
   } else {
-    if(*previous == NULL){
-      head = alloc_node->next;
-    }
-    else{
-      (*previous)->next = alloc_node->next; 
-    }   
+    size = size_of(alloc_node);
+    next_block(alloc_node)->size &= ~(size_t)PREV_FREE;
   }
 
-  *allocated = (header_t *)alloc_node; 
-  (*allocated)->size = size; 
+  *allocated = (header_t *)alloc_node;
+  (*allocated)->size = size;  // a free block never follows another one
   (*allocated)->magic = MAGIC;
+  (*allocated)->owner = 0;
 
+  in_use += size + sizeof(header_t);
+  note_reach(alloc_node, after);
 }
 
-// Returns a pointer to a region of memory having at least the request `size`
-// bytes.
+// Returns a pointer to a region of the heap having at least `size` bytes
+// (already rounded up), the way my_malloc() does outside thread-safe mode.
+//
+// Small requests are served from the bin of their size class when it has a
+// block, in O(1). Everything else, and small requests whose bin is empty,
+// is split off the free list. If nothing there is big enough, the bins are
+// consolidated into the list and the search repeated once, so memory parked
+// in bins is never lost to a large request. Only then is the heap grown by
+// another chunk.
 //
 // PARAMETERS:
 // size - the number of bytes requested to allocate
@@ -166,100 +625,550 @@ void split(size_t size, node_t **previous, node_t **free_block,
 // RETURNS:
 // A void pointer to the region of allocated memory
 //
-void *my_malloc(size_t size) {
-  // TODO
+static void *heap_malloc(size_t size) {
   node_t *previous = NULL;
   node_t *free_block = NULL;
   header_t *allocated = NULL;
 
+  heap();
+  zero_from = NULL;
+  zero_to = NULL;
+
+  if (size <= SMALL_MAX && bins[bin_index(size)] != NULL) {
+    node_t *block = bins[bin_index(size)];
+    bins[bin_index(size)] = block->next;
+    allocated = (header_t *)block;  // size and PREV_FREE are still right
+    allocated->magic = MAGIC;
+    allocated->owner = 0;
+    in_use += size + sizeof(header_t);
+    return (void *)(((char *)allocated) + sizeof(header_t));
+  }
+
   find_free(size, &free_block, &previous);
+  if (free_block == NULL && consolidate()) {
+    find_free(size, &free_block, &previous);
+  }
 
-  if(free_block == NULL){
-    return NULL;
+  if (free_block == NULL) {
+    free_block = grow_heap(size);
+    if (free_block == NULL) {
+      return NULL;
+    }
+    previous = prev_link(free_block);
   }
 
   split(size, &previous, &free_block, &allocated);
 
-  return (void *)(((char *)allocated) + sizeof(header_t));; 
+  return (void *)(((char *)allocated) + sizeof(header_t));
 }
 
 /*
- * Coalesces a free block with its neighbors if they are also free.
+ * Coalesces a free block with its neighbors if they are also free, and puts
+ * the result on the free list.
  *
- * The function assumes the free_list is sorted order. One way to do this is to
- * check the arrdress of the blocks, and insert the new block such that the
- * address of the new block is greater than the address of the previous block
- * and less than the address of the next block.
- *
- * @hints
- *   - find the location in the free_list where the new block should be
- inserted.
- *   - First check if the next free block id physically adjacent to the new
- block.
- *     If so, merge the two blocks.
- *   - Next check if the previous free block is physically adjacent to the new
- *     block. If so, merge the two blocks.
+ * The boundary tags say whether the blocks physically before and after
+ * `free_block` are free, and where the one before starts, so merging never
+ * searches the list: each free neighbor is unlinked in O(1) and the merged
+ * block takes the list position of the lowest-addressed one.
  *
  * @warning
- *  - Make sure to update the next pinters correctlly.
- *  - If the new block is the first block in the free list, make sure to update
- *    the head pointer to point to the new block.
+ *  - Only an isolated block (no free neighbor) under an address-ordered
+ *    policy walks the list, to find its place; the other policies push it
+ *    on the front.
+ *  - The fence after the last block of each chunk is not memory that can be
+ *    handed out, so it is never merged, and blocks of different chunks
+ *    never are either.
 
  * PARAMETERS:
  * free_block - the block to coalesce
  *
+ * RETURNS:
+ * the merged block
+ *
  */
-void coalesce(node_t *free_block) {
-  node_t *next = head;
-  node_t *prev = NULL;
+node_t *coalesce(node_t *free_block) {
+  node_t *block = free_block;
+  node_t *after = NULL;  // the list node to link the result after
+  bool placed = false;   // `after` is known
+  bool at_rover = false;
+
+  node_t *next = next_block(block);
+  if (next->size & BLOCK_FREE) {
+    at_rover = rover == next;
+    after = prev_link(next);
+    placed = true;
+    list_remove(next);
+    set_size(block, size_of(block) + sizeof(node_t) + size_of(next));
+  }
+
+  if (block->size & PREV_FREE) {
+    node_t *prev = prev_block(block);
+    at_rover = at_rover || rover == prev;
+    after = prev_link(prev);
+    placed = true;
+    list_remove(prev);
+    set_size(prev, size_of(prev) + sizeof(node_t) + size_of(block));
+    block = prev;
+  }
+
+  if (!address_ordered()) {
+    after = NULL;
+  } else if (!placed) {
+    node_t *next_free = head;
+    while (next_free != tail && next_free < block) {
+      after = next_free;
+      next_free = next_free->next;
+    }
+  }
 
-  while(next && next < free_block){
-    prev = next; 
-    next = next->next;
+  mark_free(block);
+  list_insert(block, after);
+  if (at_rover) {
+    rover = block;
   }
+  return block;
+}
+
+// Empties every bin into the free list, merging each block with its free
+// neighbors.
+//
+// RETURNS:
+// true if any block was moved
+//
+bool consolidate() {
+  bool moved = false;
+  for (int i = 0; i < NUM_BINS; i++) {
+    while (bins[i] != NULL) {
+      node_t *block = bins[i];
+      bins[i] = block->next;
+      coalesce(block);
+      moved = true;
+    }
+  }
+  return moved;
+}
+
+// Frees a given region of memory back to the heap, the way my_free() does
+// outside thread-safe mode.
+//
+// Small blocks are pushed onto the bin of their size class, in O(1); the
+// rest are merged into the free list by coalesce(), also in O(1) unless
+// the policy needs address order and the block has no free neighbor. A
+// chunk left entirely free is unmapped if enough free memory remains in the
+// rest of the heap (see RELEASE_THRESHOLD); blocks waiting in bins keep
+// their chunk mapped.
+//
+// PARAMETERS:
+// allocated - a pointer to a region of memory previously allocated by my_malloc
+//
+static void heap_free(void *allocated) {
+  header_t *header = (header_t*)((char *)allocated - sizeof(header_t));
+  assert(header->magic == MAGIC);
+  node_t *free_node = (node_t *)header;
+  size_t size = size_of(free_node);
+  in_use -= size + sizeof(header_t);
 
-    free_block->next = next;
+  if (size <= SMALL_MAX) {
+    free_node->next = bins[bin_index(size)];
+    bins[bin_index(size)] = free_node;
+    return;
+  }
+  node_t *block = coalesce(free_node);
 
-    if(prev){
-      prev->next = free_block;
-    } else {
-      head = free_block;
+  node_t *fence = next_block(block);
+  if (size_of(fence) == 0) {
+    chunk_t *chunk = chunk_of(fence);
+    if (chunk->base == block && chunk != first &&
+        mapped - chunk->size - in_use >= release_threshold) {
+      list_remove(block);
+      unmap_chunk(chunk);
     }
+  }
+}
 
-  
+// Cuts the payload of allocated `block` down to `size` bytes if what is left
+// over is big enough to be a block of its own.
+//
+// RETURNS:
+// the left-over block, neither tagged free nor on the free list, or NULL
+//
+static node_t *carve_tail(node_t *block, size_t size) {
+  if (size_of(block) < size + sizeof(node_t) + ALIGNMENT) {
+    return NULL;
+  }
+  node_t *rest = (node_t *)((char *)(block + 1) + size);
+  rest->size = size_of(block) - size - sizeof(node_t);
+  set_size(block, size);
+  in_use -= size_of(rest) + sizeof(node_t);
+  return rest;
+}
 
-  //size_t block_size = free_block->size + sizeof(node_t);
-  //size_t prev_size = prev->size + sizeof(node_t);
+// Resizes an allocated heap block in place. Shrinking gives the tail back
+// to the free list when it is big enough to be a block. Growing absorbs
+// the block physically after this one if it is free and big enough, found
+// in O(1) by the boundary tags, and puts whatever is left of it back in
+// its place on the free list.
+//
+// PARAMETERS:
+// block - the allocated block
+// size - the payload size wanted, already rounded up
+//
+// RETURNS:
+// true if the block now has a payload of at least `size` bytes
+//
+static bool heap_resize(node_t *block, size_t size) {
+  size_t old = size_of(block);
+  if (size <= old) {
+    node_t *rest = carve_tail(block, size);
+    if (rest != NULL) {
+      coalesce(rest);
+    }
+    return true;
+  }
+
+  node_t *next = next_block(block);
+  if (!(next->size & BLOCK_FREE) ||
+      old + sizeof(node_t) + size_of(next) < size) {
+    return false;
+  }
+  node_t *after = next_block(next);
+  node_t *list_after = prev_link(next);
+  bool at_rover = rover == next;
+  list_remove(next);
+  set_size(block, old + sizeof(node_t) + size_of(next));
+  in_use += size_of(block) - old;
+
+  node_t *rest = carve_tail(block, size);
+  if (rest != NULL) {
+    mark_free(rest);
+    list_insert(rest, list_after);
+    if (at_rover) {
+      rover = rest;
+    }
+  } else {
+    after->size &= ~(size_t)PREV_FREE;
+  }
+  note_reach(block, after);
+  return true;
+}
+
+// The link to the next block of a cache bin or remote stack, kept in the
+// block's first payload word.
+static inline node_t *&cache_next(node_t *block) {
+  return *(node_t **)((header_t *)block + 1);
+}
+
+// Gives every block in a thread cache, its remote stack included, back to
+// the heap. The caller holds the heap lock.
+static void flush_cache(thread_cache_t *c) {
+  for (int i = 0; i < NUM_BINS; i++) {
+    while (c->bins[i] != NULL) {
+      header_t *block = (header_t *)c->bins[i];
+      c->bins[i] = cache_next(c->bins[i]);
+      heap_free(block + 1);
+    }
+    c->counts[i] = 0;
+  }
+  node_t *block = c->remote.exchange(NULL, std::memory_order_acquire);
+  while (block != NULL) {
+    node_t *next = cache_next(block);
+    heap_free((header_t *)block + 1);
+    block = next;
+  }
+}
+
+// Hands the calling thread's cache back when the thread exits, so another
+// thread can take it over.
+struct cache_release_t {
+  ~cache_release_t() {
+    if (cache != NULL) {
+      pthread_mutex_lock(&heap_lock);
+      flush_cache(cache);
+      pthread_mutex_unlock(&heap_lock);
+      cache->taken.store(false, std::memory_order_release);
+      cache = NULL;
+    }
+  }
+};
+static thread_local cache_release_t cache_release;
+
+// Returns the calling thread's cache, claiming a free one on first use.
+//
+// RETURNS:
+// the cache, or NULL if all MAX_CACHES are taken
+//
+static thread_cache_t *get_cache() {
+  if (cache == NULL && !no_cache) {
+    for (int i = 0; i < MAX_CACHES && cache == NULL; i++) {
+      bool expected = false;
+      if (caches[i].taken.compare_exchange_strong(expected, true)) {
+        cache = &caches[i];
+        (void)&cache_release;  // registers the exit hook for this thread
+      }
+    }
+    no_cache = cache == NULL;
+  }
+  return cache;
+}
+
+// Pushes a block onto its cache's bin.
+static inline void cache_push(thread_cache_t *c, node_t *block) {
+  int i = ((header_t *)block)->bin;
+  cache_next(block) = c->bins[i];
+  c->bins[i] = block;
+  c->counts[i]++;
+}
+
+// Serves a small request from the calling thread's cache. An empty bin is
+// filled first from the blocks other threads have freed, and failing that
+// with CACHE_BATCH fresh blocks from the heap, under one lock.
+//
+// PARAMETERS:
+// c - the calling thread's cache
+// size - the number of bytes requested, rounded up, at most SMALL_MAX
+//
+// RETURNS:
+// A void pointer to the region of allocated memory, or NULL
+//
+static void *cache_malloc(thread_cache_t *c, size_t size) {
+  int i = bin_index(size);
+  if (c->bins[i] == NULL &&
+      c->remote.load(std::memory_order_relaxed) != NULL) {
+    node_t *block = c->remote.exchange(NULL, std::memory_order_acquire);
+    while (block != NULL) {
+      node_t *next = cache_next(block);
+      cache_push(c, block);
+      block = next;
+    }
+  }
+  if (c->bins[i] == NULL) {
+    pthread_mutex_lock(&heap_lock);
+    for (int n = 0; n < CACHE_BATCH; n++) {
+      void *p = heap_malloc(size);
+      if (p == NULL) {
+        break;
+      }
+      // A block may come with a little slack (see split()). It still fits
+      // this bin, and comes back to it while the cache holds it.
+      node_t *block = (node_t *)((char *)p - sizeof(header_t));
+      cache_next(block) = c->bins[i];
+      c->bins[i] = block;
+      c->counts[i]++;
+    }
+    pthread_mutex_unlock(&heap_lock);
+    if (c->bins[i] == NULL) {
+      return NULL;
+    }
+  }
 
+  header_t *allocated = (header_t *)c->bins[i];
+  c->bins[i] = cache_next(c->bins[i]);
+  c->counts[i]--;
+  allocated->owner = c - caches + 1;
+  allocated->bin = i;
+  return (void *)(allocated + 1);
+}
 
-  if (next && 
-    (char *)free_block + (free_block->size + sizeof(node_t)) == (char *)next){
-      free_block->size += next->size + sizeof(node_t);
-      free_block->next = next->next;
+// Frees a small block that came from a thread cache. The owner keeps it;
+// once a bin holds more than CACHE_MAX blocks, CACHE_BATCH of them go back
+// to the heap. Any other thread hands it to the owner's remote stack.
+static void cache_free(header_t *header) {
+  thread_cache_t *owner = &caches[header->owner - 1];
+  node_t *block = (node_t *)header;
+  if (owner != get_cache()) {
+    node_t *top = owner->remote.load(std::memory_order_relaxed);
+    do {
+      cache_next(block) = top;
+    } while (!owner->remote.compare_exchange_weak(
+        top, block, std::memory_order_release, std::memory_order_relaxed));
+    return;
+  }
 
-   }
+  cache_push(owner, block);
+  int i = header->bin;
+  if (owner->counts[i] > CACHE_MAX) {
+    pthread_mutex_lock(&heap_lock);
+    for (int n = 0; n < CACHE_BATCH; n++) {
+      header_t *extra = (header_t *)owner->bins[i];
+      owner->bins[i] = cache_next(owner->bins[i]);
+      heap_free(extra + 1);
+    }
+    owner->counts[i] -= CACHE_BATCH;
+    pthread_mutex_unlock(&heap_lock);
+  }
+}
 
-   
-  if (prev){ 
-   if (((char *)prev) + (prev->size + sizeof(node_t)) == (char* )free_block){
-    prev->size += free_block->size + sizeof(node_t);
-    prev->next = free_block->next;
+// Turns thread-safe mode on or off; call it while only one thread is using
+// the allocator. Turning it off gives every cached block back to the heap.
+void set_thread_safe(bool on) {
+  if (thread_safe && !on) {
+    for (int i = 0; i < MAX_CACHES; i++) {
+      flush_cache(&caches[i]);
     }
- }
+  }
+  thread_safe = on;
+}
 
- return;
+// Returns a pointer to a region of memory having at least the request `size`
+// bytes.
+//
+// In thread-safe mode small requests come from the calling thread's cache,
+// and everything else from the heap under the heap lock.
+//
+// PARAMETERS:
+// size - the number of bytes requested to allocate
+//
+// RETURNS:
+// A void pointer to the region of allocated memory
+//
+void *my_malloc(size_t size) {
+  size = round_up(size);
+  if (!thread_safe) {
+    return heap_malloc(size);
+  }
+  thread_cache_t *c = size <= SMALL_MAX ? get_cache() : NULL;
+  if (c != NULL) {
+    return cache_malloc(c, size);
+  }
+  pthread_mutex_lock(&heap_lock);
+  void *allocated = heap_malloc(size);
+  pthread_mutex_unlock(&heap_lock);
+  return allocated;
 }
 
-// Frees a given region of memory back to the free list.
+// Frees a given region of memory.
+//
+// In thread-safe mode a small block from a thread cache goes back to that
+// cache, whichever thread frees it; everything else goes to the heap under
+// the heap lock.
 //
 // PARAMETERS:
 // allocated - a pointer to a region of memory previously allocated by my_malloc
 //
 void my_free(void *allocated) {
-  // TODO
-  header_t *header = (header_t*)((char *)allocated - sizeof(header_t));
+  if (!thread_safe) {
+    heap_free(allocated);
+    return;
+  }
+  header_t *header = (header_t *)((char *)allocated - sizeof(header_t));
   assert(header->magic == MAGIC);
-  node_t *free_node = (node_t *)header;
-  free_node->size = header->size;
-  coalesce(free_node);
+  if (header->owner != 0) {
+    cache_free(header);
+    return;
+  }
+  pthread_mutex_lock(&heap_lock);
+  heap_free(allocated);
+  pthread_mutex_unlock(&heap_lock);
+}
+
+// Resizes the region at `ptr` to at least `size` bytes, keeping its
+// contents up to the smaller of the two sizes.
+//
+// A heap block is resized in place when it can be (see heap_resize()), so
+// a buffer grown in small steps at the end of the heap is never copied.
+// Otherwise a new region is allocated, the contents copied, and the old
+// one freed. Blocks from a thread cache only stay put when they already
+// hold `size` bytes.
+//
+// PARAMETERS:
+// ptr - a region previously allocated by my_malloc, or NULL to allocate one
+// size - the number of bytes wanted, or 0 to free `ptr`
+//
+// RETURNS:
+// A void pointer to the resized region, or NULL if there is no memory for
+// it (`ptr` is left as it was) or `size` was 0
+//
+void *my_realloc(void *ptr, size_t size) {
+  if (ptr == NULL) {
+    return my_malloc(size);
+  }
+  if (size == 0) {
+    my_free(ptr);
+    return NULL;
+  }
+  header_t *header = (header_t *)((char *)ptr - sizeof(header_t));
+  assert(header->magic == MAGIC);
+  node_t *block = (node_t *)header;
+
+  // The bytes to copy if the region moves. In thread-safe mode the heap
+  // may set flags in `size` at any time outside the lock, so a cached block
+  // goes by its bin, which it holds at least, and a heap block's size is
+  // read under the lock.
+  size_t held;
+  bool resized;
+  if (thread_safe && header->owner != 0) {
+    held = (size_t)(header->bin + 1) * ALIGNMENT;
+    resized = round_up(size) <= held;
+  } else if (thread_safe) {
+    pthread_mutex_lock(&heap_lock);
+    held = size_of(block);
+    resized = heap_resize(block, round_up(size));
+    pthread_mutex_unlock(&heap_lock);
+  } else {
+    held = size_of(block);
+    resized = heap_resize(block, round_up(size));
+  }
+  if (resized) {
+    return ptr;
+  }
+
+  void *moved = my_malloc(size);
+  if (moved == NULL) {
+    return NULL;
+  }
+  memcpy(moved, ptr, held);
+  my_free(ptr);
+  return moved;
+}
+
+// Returns a zeroed region of memory for `count` objects of `size` bytes.
+//
+// Memory fresh from mmap is zero already, so only the part of the block
+// that has been written before is cleared: for a block carved out of
+// untouched memory at the end of a chunk that is a few words, not the
+// whole block.
+//
+// RETURNS:
+// A void pointer to the zeroed region, or NULL if there is no memory for
+// it or `count` * `size` overflows
+//
+void *my_calloc(size_t count, size_t size) {
+  if (size != 0 && count > (size_t)-1 / size) {
+    return NULL;
+  }
+  size_t bytes = count * size;
+  size_t rounded = round_up(bytes);
+  char *p;
+  char *from = NULL, *to = NULL;
+  if (thread_safe && rounded <= SMALL_MAX && get_cache() != NULL) {
+    p = (char *)cache_malloc(cache, rounded);
+  } else {
+    if (thread_safe) {
+      pthread_mutex_lock(&heap_lock);
+    }
+    p = (char *)heap_malloc(rounded);
+    from = zero_from;
+    to = zero_to;
+    if (thread_safe) {
+      pthread_mutex_unlock(&heap_lock);
+    }
+  }
+  if (p == NULL) {
+    return NULL;
+  }
+
+  char *end = p + bytes;
+  if (from < p) {
+    from = p;
+  }
+  if (to > end) {
+    to = end;
+  }
+  if (from < to) {
+    memset(p, 0, from - p);
+    memset(to, 0, end - to);
+  } else {
+    memset(p, 0, bytes);
+  }
+  return p;
 }
@@ -0,0 +1,95 @@
+#include <assert.h>
+#include <pool.h>
+
+// Creates an empty pool for objects of `obj_size` bytes. No slab is taken
+// from my_malloc() until the first pool_alloc().
+//
+// RETURNS:
+// the pool, or NULL if my_malloc() has no memory for it
+//
+pool_t *pool_create(size_t obj_size) {
+  pool_t *pool = (pool_t *)my_malloc(sizeof(pool_t));
+  if (pool == NULL) {
+    return NULL;
+  }
+  if (obj_size < POOL_ALIGN) {
+    obj_size = POOL_ALIGN;
+  }
+  pool->obj_size = (obj_size + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1);
+  pool->slab_size = POOL_SLAB_SIZE - POOL_SLAB_SIZE % pool->obj_size;
+  if (pool->slab_size == 0) {
+    pool->slab_size = pool->obj_size;
+  }
+  pool->free = NULL;
+  pool->carve = NULL;
+  pool->carve_end = NULL;
+  pool->slabs = NULL;
+  pool->live = 0;
+  pool->num_slabs = 0;
+  return pool;
+}
+
+// Returns an object of the pool's size: the most recently freed one if
+// there is one, otherwise the next one carved off the newest slab, which
+// is allocated first if it is used up.
+//
+// RETURNS:
+// A pointer to the object, or NULL if my_malloc() has no memory for a slab
+//
+void *pool_alloc(pool_t *pool) {
+  void *obj = pool->free;
+  if (obj != NULL) {
+    pool->free = *(void **)obj;
+  } else {
+    if (pool->carve == pool->carve_end) {
+      slab_t *slab = (slab_t *)my_malloc(sizeof(slab_t) + pool->slab_size);
+      if (slab == NULL) {
+        return NULL;
+      }
+      slab->next = pool->slabs;
+      pool->slabs = slab;
+      pool->num_slabs++;
+      pool->carve = (char *)(slab + 1);
+      pool->carve_end = pool->carve + pool->slab_size;
+    }
+    obj = pool->carve;
+    pool->carve += pool->obj_size;
+  }
+  pool->live++;
+  return obj;
+}
+
+// Returns an object to its pool. It goes on the front of the free list and
+// is the next one pool_alloc() hands out.
+//
+// PARAMETERS:
+// pool - the pool the object came from
+// obj - a pointer previously returned by pool_alloc(pool)
+//
+void pool_free(pool_t *pool, void *obj) {
+  assert(pool->live > 0);
+  *(void **)obj = pool->free;
+  pool->free = obj;
+  pool->live--;
+}
+
+// Frees every object of the pool at once, giving all its slabs back to
+// my_malloc(). The pool stays usable.
+void pool_release(pool_t *pool) {
+  while (pool->slabs != NULL) {
+    slab_t *slab = pool->slabs;
+    pool->slabs = slab->next;
+    my_free(slab);
+  }
+  pool->free = NULL;
+  pool->carve = NULL;
+  pool->carve_end = NULL;
+  pool->live = 0;
+  pool->num_slabs = 0;
+}
+
+// Frees every object of the pool, and the pool itself.
+void pool_destroy(pool_t *pool) {
+  pool_release(pool);
+  my_free(pool);
+}
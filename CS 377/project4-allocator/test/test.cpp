@@ -1,5 +1,11 @@
 #include <gtest/gtest.h>
 #include <my_malloc.h>
+#include <pool.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
 
 using namespace std;
 
@@ -21,6 +27,287 @@ TEST(MallocTest, SimpleMallocCall) {
   ASSERT_TRUE(p != NULL);
 }
 
+// a freed small block is handed straight back to the next request of its
+// size class, and still counts as free memory while it waits in its bin
+TEST(MallocTest, SmallBlocksAreBinned) {
+  reset_heap();
+  void *p = my_malloc(24);
+  void *q = my_malloc(100);
+  size_t before = available_memory();
+  my_free(p);
+  EXPECT_EQ(number_of_free_nodes(), 2);
+  EXPECT_EQ(available_memory(), before + 32);
+  EXPECT_EQ(my_malloc(20), p);
+  EXPECT_EQ(available_memory(), before);
+  my_free(q);
+  EXPECT_EQ(my_malloc(112), q);
+}
+
+// memory parked in bins is merged back when a large request needs it
+TEST(MallocTest, BinsConsolidateForLargeRequests) {
+  set_heap_growth(false, RELEASE_THRESHOLD, HEAP_SIZE);
+  reset_heap();
+  vector<void *> blocks;
+  void *p;
+  while ((p = my_malloc(32)) != NULL) blocks.push_back(p);
+  EXPECT_EQ(blocks.size(), (HEAP_SIZE - sizeof(node_t)) / (32 + sizeof(header_t)));
+  for (void *b : blocks) my_free(b);
+  EXPECT_EQ(available_memory(), HEAP_SIZE - sizeof(node_t) -
+                                    (blocks.size() - 1) * sizeof(header_t));
+
+  p = my_malloc(2000);
+  ASSERT_TRUE(p != NULL);
+  my_free(p);
+  EXPECT_EQ(number_of_free_nodes(), 1);
+  EXPECT_EQ(available_memory(), HEAP_SIZE - sizeof(node_t));
+  set_heap_growth(false, RELEASE_THRESHOLD, 0);
+}
+
+// with holes of 512 and 304 bytes and the rest of the heap after them,
+// each policy places the same 300-byte request differently
+TEST(MallocTest, FitPolicies) {
+  for (int policy : {FIT_FIRST, FIT_NEXT, FIT_BEST, FIT_GOOD}) {
+    reset_heap();
+    set_fit_policy(policy);
+    void *a = my_malloc(512);
+    void *b = my_malloc(272);
+    void *c = my_malloc(304);
+    void *d = my_malloc(272);
+    my_free(a);
+    my_free(c);
+
+    void *expected = c;
+    if (policy == FIT_FIRST) expected = a;
+    if (policy == FIT_NEXT) expected = (char *)d + 272 + sizeof(header_t);
+    void *p = my_malloc(300);
+    EXPECT_EQ(p, expected) << "policy " << policy;
+
+    my_free(p);
+    my_free(b);
+    my_free(d);
+    EXPECT_EQ(number_of_free_nodes(), 1) << "policy " << policy;
+    EXPECT_EQ(heap_in_use(), 0u);
+  }
+  set_fit_policy(FIT_FIRST);
+}
+
+// boundary tags merge neighbors whichever order blocks are freed in
+TEST(MallocTest, CoalesceInAnyOrder) {
+  mt19937 rng(377);
+  set_heap_growth(false, RELEASE_THRESHOLD, HEAP_SIZE);
+  for (int policy : {FIT_FIRST, FIT_NEXT, FIT_BEST, FIT_GOOD}) {
+    for (int round = 0; round < 20; round++) {
+      reset_heap();
+      set_fit_policy(policy);
+      vector<void *> blocks;
+      void *p;
+      while ((p = my_malloc(SMALL_MAX + 1 + rng() % 200)) != NULL) {
+        blocks.push_back(p);
+      }
+      shuffle(blocks.begin(), blocks.end(), rng);
+      for (void *b : blocks) my_free(b);
+      EXPECT_EQ(number_of_free_nodes(), 1) << "policy " << policy;
+      EXPECT_EQ(available_memory(), HEAP_SIZE - sizeof(node_t));
+    }
+  }
+  set_fit_policy(FIT_FIRST);
+  set_heap_growth(false, RELEASE_THRESHOLD, 0);
+}
+
+// only the address-ordered policies search for a freed block's place
+TEST(MallocTest, FreeListOrder) {
+  for (int policy : {FIT_FIRST, FIT_BEST}) {
+    reset_heap();
+    set_fit_policy(policy);
+    void *a = my_malloc(512);
+    void *b = my_malloc(272);
+    void *c = my_malloc(304);
+    void *d = my_malloc(272);
+    my_free(a);
+    my_free(c);
+    void *first = policy == FIT_FIRST ? a : c;
+    EXPECT_EQ(free_list(), (node_t *)((char *)first - sizeof(header_t)));
+    my_free(b);
+    my_free(d);
+    EXPECT_EQ(number_of_free_nodes(), 1);
+  }
+  set_fit_policy(FIT_FIRST);
+}
+
+// the heap grows by chunks when the first one is full, reports free memory
+// across all of them, and unmaps them again once they are entirely free
+TEST(MallocTest, HeapGrowsAndShrinks) {
+  for (int policy : {FIT_FIRST, FIT_NEXT, FIT_BEST, FIT_GOOD}) {
+    set_heap_growth(false, 0, 0);
+    reset_heap();
+    set_fit_policy(policy);
+    vector<void *> blocks;
+    for (int i = 0; i < 200; i++) blocks.push_back(my_malloc(1000));
+    for (void *b : blocks) ASSERT_TRUE(b != NULL);
+    EXPECT_GT(heap_chunks(), 2);
+    EXPECT_EQ(available_memory(), heap_mapped() - heap_in_use() -
+                                      number_of_free_nodes() * sizeof(node_t));
+    for (size_t i = 0; i < blocks.size(); i += 2) my_free(blocks[i]);
+    for (size_t i = 1; i < blocks.size(); i += 2) my_free(blocks[i]);
+    EXPECT_EQ(heap_chunks(), 1) << "policy " << policy;
+    EXPECT_EQ(number_of_free_nodes(), 1);
+    EXPECT_EQ(available_memory(), HEAP_SIZE - sizeof(node_t));
+  }
+  set_fit_policy(FIT_FIRST);
+  set_heap_growth(false, RELEASE_THRESHOLD, 0);
+}
+
+// a request bigger than the next chunk gets a chunk of its own, on huge
+// page boundaries when huge pages are on
+TEST(MallocTest, HugePageChunks) {
+  set_heap_growth(true, 0, 0);
+  reset_heap();
+  void *p = my_malloc(3 << 20);
+  ASSERT_TRUE(p != NULL);
+  EXPECT_EQ(heap_chunks(), 2);
+  EXPECT_EQ(((uintptr_t)p - sizeof(header_t)) % HUGE_PAGE_SIZE, 0u);
+  EXPECT_GE(heap_mapped(), HEAP_SIZE + (3u << 20));
+  my_free(p);
+  EXPECT_EQ(heap_chunks(), 1);
+  EXPECT_EQ(heap_mapped(), (size_t)HEAP_SIZE);
+  set_heap_growth(false, RELEASE_THRESHOLD, 0);
+}
+
+// a block grows in place into the free block after it, moves only when
+// that is not free, and shrinking gives its tail back
+TEST(MallocTest, Realloc) {
+  for (int policy : {FIT_FIRST, FIT_NEXT, FIT_BEST, FIT_GOOD}) {
+    reset_heap();
+    set_fit_policy(policy);
+    char *p = (char *)my_malloc(300);
+    memset(p, 'x', 300);
+    EXPECT_EQ(my_realloc(p, 1000), p) << "policy " << policy;
+    memset(p + 300, 'y', 700);
+    void *q = my_malloc(300);
+    char *moved = (char *)my_realloc(p, 2000);
+    ASSERT_TRUE(moved != NULL);
+    EXPECT_NE(moved, p);
+    EXPECT_EQ(string(moved, 1000), string(300, 'x') + string(700, 'y'));
+
+    size_t before = available_memory();
+    EXPECT_EQ(my_realloc(moved, 500), moved);
+    EXPECT_EQ(available_memory(), before + 1504 - sizeof(node_t));
+    my_free(q);
+    EXPECT_EQ(my_realloc(moved, 0), (void *)NULL);
+    EXPECT_EQ(number_of_free_nodes(), 1) << "policy " << policy;
+    EXPECT_EQ(heap_in_use(), 0u);
+  }
+  set_fit_policy(FIT_FIRST);
+}
+
+// calloc'd memory is zero whether it was used before or is fresh from mmap
+TEST(MallocTest, Calloc) {
+  reset_heap();
+  char *p = (char *)my_malloc(1000);
+  memset(p, -1, 1000);
+  my_free(p);
+  char *z = (char *)my_calloc(10, 100);
+  EXPECT_EQ(z, p);
+  EXPECT_EQ(string(z, 1000), string(1000, 0));
+  char *big = (char *)my_calloc(1000, 100);
+  EXPECT_EQ(string(big, 100000), string(100000, 0));
+  EXPECT_EQ(my_calloc((size_t)-1 / 2, 4), (void *)NULL);
+  my_free(z);
+  my_free(big);
+}
+
+// fills a block with a pattern that says how big it is
+static void *tagged_malloc(size_t size) {
+  char *p = (char *)my_malloc(size);
+  memcpy(p, &size, sizeof(size));
+  memset(p + sizeof(size), (char)size, size - sizeof(size));
+  return p;
+}
+
+// checks the pattern is intact, so no one else wrote to the block, and
+// frees it
+static void tagged_free(void *p) {
+  size_t size;
+  memcpy(&size, p, sizeof(size));
+  for (size_t i = sizeof(size); i < size; i++) {
+    ASSERT_EQ(((char *)p)[i], (char)size);
+  }
+  my_free(p);
+}
+
+// in thread-safe mode threads allocate and free concurrently, one another's
+// blocks included, and every block makes its way back to the heap
+TEST(MallocTest, ThreadSafeMode) {
+  const int threads = 4;
+  std::atomic<void *> mailbox[threads];
+  for (auto &m : mailbox) m.store(NULL);
+  reset_heap();
+  set_thread_safe(true);
+
+  vector<thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&mailbox, t] {
+      mt19937 rng(t);
+      vector<void *> live;
+      for (int i = 0; i < 20000; i++) {
+        size_t size = sizeof(size_t) + (rng() % 8 ? rng() % 200 : rng() % 2000);
+        void *p = tagged_malloc(size);
+        if (i % 4 == 0) {
+          p = mailbox[(t + 1) % threads].exchange(p);
+          if (p == NULL) continue;
+        }
+        live.push_back(p);
+        if (live.size() > 100) {
+          size_t k = rng() % live.size();
+          tagged_free(live[k]);
+          live[k] = live.back();
+          live.pop_back();
+        }
+      }
+      for (void *p : live) tagged_free(p);
+    });
+  }
+  for (thread &w : workers) w.join();
+  for (auto &m : mailbox) {
+    if (m.load() != NULL) tagged_free(m.load());
+  }
+
+  set_thread_safe(false);
+  EXPECT_EQ(heap_in_use(), 0u);
+  EXPECT_EQ(available_memory(),
+            heap_mapped() - number_of_free_nodes() * sizeof(node_t));
+}
+
+// pool objects are packed back to back without headers, freed ones are
+// reused first, and releasing the pool gives every slab back at once
+TEST(PoolTest, AllocFreeRelease) {
+  reset_heap();
+  pool_t *pool = pool_create(20);
+  size_t in_use = heap_in_use();
+  EXPECT_EQ(pool->obj_size, 24u);
+
+  vector<char *> objs;
+  for (int i = 0; i < 1000; i++) objs.push_back((char *)pool_alloc(pool));
+  size_t per_slab = POOL_SLAB_SIZE / 24;
+  EXPECT_EQ(pool->num_slabs, (1000 + per_slab - 1) / per_slab);
+  for (size_t i = 1; i < per_slab; i++) EXPECT_EQ(objs[i], objs[i - 1] + 24);
+  vector<char *> sorted = objs;
+  sort(sorted.begin(), sorted.end());
+  EXPECT_EQ(unique(sorted.begin(), sorted.end()), sorted.end());
+
+  pool_free(pool, objs[10]);
+  pool_free(pool, objs[500]);
+  EXPECT_EQ(pool_alloc(pool), objs[500]);
+  EXPECT_EQ(pool_alloc(pool), objs[10]);
+  EXPECT_EQ(pool->live, 1000u);
+
+  pool_release(pool);
+  EXPECT_EQ(heap_in_use(), in_use);
+  EXPECT_EQ(pool->live, 0u);
+  EXPECT_TRUE(pool_alloc(pool) != NULL);
+  pool_destroy(pool);
+  EXPECT_EQ(heap_in_use(), 0u);
+}
 
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);